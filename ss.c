@@ -1,182 +1,3267 @@
+#define _GNU_SOURCE // pthread_setaffinity_np
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <time.h>
 #include <pthread.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 #include "flint/flint.h"
-#include "flint/fmpz.h"
-#include "flint/fmpz_factor.h"
 
+// n < 2**63 has at most 15 distinct prime factors
+#define MAX_OMEGA 15
+// the default number of n factored at once by the sieve
+#define BLOCK_SIZE 8192
+// the default number of n a thread takes from the queue at once
+#define CHUNK_SIZE (64 * BLOCK_SIZE)
+// --perf-counters counts cycles, instructions, cache misses, and branch misses
+#define PERF_EVENTS 4
+// ... in the factorization, criterion, and bookkeeping phases
+#define PERF_PHASES 3
+#define PHASE_FACTOR 0
+#define PHASE_CRITERION 1
+#define PHASE_BOOKKEEPING 2
+// --coprime puts the small primes of k on the wheel while it has at most FILTER_CLASSES classes
+#define FILTER_CLASSES 48
+// the entries per page of a bucket of large primes
+#define BUCKET_PAGE 1024
+// --autotune times each candidate on the first AUTOTUNE_WINDOW n of a chunk per thread at the top of the range
+// the smallest block size it tries, and that a --profile may set
+#define AUTOTUNE_MIN_BLOCK (1 << 8)
+#define AUTOTUNE_WINDOW (1 << 22)
+// ... and only on a run of at least AUTOTUNE_SHARE such windows per thread, so the calibration stays a small part of it
+#define AUTOTUNE_SHARE 64
+// the order table covers the primes below SMALL_LIMIT
+#define SMALL_LIMIT 1024
+// --dispatch routes n by omega(n) and its largest exponent, with 4 and above sharing a bucket
+#define DISPATCH_EXP 4
+// --dispatch re-profiles a thread's block every PROFILE_PERIOD blocks
+#define PROFILE_PERIOD 1024
+// the fewest samples of a bucket in a profiled block to re-route it
+#define PROFILE_MIN 16
+// the criteria of ss.c, ss_h.c, and ss_pazderski.c
+#define NUM_CRITERIA 3
+// --bench-kernels times each omega on BENCH_SAMPLES factorizations, BENCH_REPS times
+#define BENCH_SAMPLES 4096
+#define BENCH_REPS 256
+
+// --stats keeps n mod m for 2 <= m <= STATS_MOD
+#define STATS_MOD 12
+
+// --list sorts and encodes the ss numbers LIST_BLOCK at a time
+#define LIST_BLOCK (1 << 24)
+// the entries buffered per block before they are spilled to a temporary file
+#define LIST_BUFFER (1 << 14)
+
+#define TABLE_MAGIC "SSTABLE"
+#define TABLE_VERSION 1
+
+#define LIST_MAGIC "SSINDEX"
+#define LIST_VERSION 1
+
+/**
+ * the --stats histograms of the ss numbers
+ */
+typedef struct {
+    slong omega[MAX_OMEGA + 1];             // by the number of distinct primes
+    slong spf[SMALL_LIMIT + 1];             // by the smallest prime, SMALL_LIMIT for the larger ones
+    slong mod[STATS_MOD + 1][STATS_MOD];    // by n mod m
+    slong exp[64];                          // by the largest exponent
+} __attribute__((aligned(64))) stats_t;
+
+typedef struct range_queue_s range_queue_t;
+
+// each thread's myarg_t gets its own cache line
 typedef struct {
-    slong count; 
+    slong count;
     slong MIN;
     slong MAX;
-} myarg_t;
+    stats_t * stats;        // NULL unless --stats
+    int cpu;                // the cpu to pin the thread to, -1 unless --pin
+    range_queue_t * queue;  // where the thread takes its chunks from
+} __attribute__((aligned(64))) myarg_t;
+
+/**
+ * the work queue of the threads; the pieces are disjoint, sorted, and taken chunk_size at a time
+ */
+struct range_queue_s {
+    pthread_mutex_t lock;
+    myarg_t * pieces;
+    slong num;
+    slong next;     // the piece being handed out
+    slong cursor;   // the next n of that piece
+    slong chunk;    // the n per chunk
+};
+
+/**
+ * the factorization of n, with the primes in increasing order
+ */
+typedef struct {
+    int num;
+    int e[MAX_OMEGA];
+    slong p[MAX_OMEGA];
+} factor_t;
+
+typedef int (* criterion_t)(const factor_t * factors);
+
+/**
+ * a large prime filed under the block it hits next, at offset i in that block
+ */
+typedef struct {
+    uint32_t p;
+    uint32_t i;
+} bucket_entry_t;
+
+/**
+ * the buckets are lists of pages, recycled through a free list
+ */
+typedef struct bucket_page_s {
+    struct bucket_page_s * next;
+    int num;
+    bucket_entry_t entries[BUCKET_PAGE];
+} bucket_page_t;
+
+/**
+ * the --dispatch timings of each criterion, by omega(n) and largest exponent
+ */
+typedef struct {
+    double ns[MAX_OMEGA + 1][DISPATCH_EXP + 1][NUM_CRITERIA];
+    slong samples[MAX_OMEGA + 1][DISPATCH_EXP + 1];
+    slong disagree; // the n on which the criteria did not agree
+} profile_t;
+
+/**
+ * the --perf-counters totals, by phase
+ */
+typedef struct {
+    uint64_t counts[PERF_PHASES][PERF_EVENTS];
+    uint64_t n;         // the n counted
+    uint64_t enabled;   // in ns, to detect multiplexing
+    uint64_t running;
+    int opened;         // the threads that got their counters
+    int threads;        // the threads, one per thread of each run_queue
+} perf_t;
+
+/**
+ * the scratch space of a thread for factor_block and the buckets, and its --dispatch state
+ */
+typedef struct {
+    slong * rem;
+    factor_t * factors;
+    int * order;        // the block sorted by bucket, when profiling
+    slong blocks;       // the blocks factored so far
+    unsigned char route[MAX_OMEGA + 1][DISPATCH_EXP + 1];
+    profile_t profile;
+    bucket_page_t ** buckets;   // the large primes by the block of the chunk they hit next
+    slong nbuckets;
+    bucket_page_t * free_pages;
+    slong fixed[MAX_OMEGA];     // the large primes that divide every n of the progression
+    int nfixed;
+    int perf_fd[PERF_EVENTS];   // -1 for the counters that could not be opened
+    int perf_phase;             // the phase the counters are running for
+    uint64_t perf_last[PERF_EVENTS];
+    perf_t perf;
+} worker_t;
+
+/**
+ * the n counted under --mod, --residue, and --coprime: those in one of the classes mod wheel
+ * that are coprime to rest, the part of the --coprime k that is not on the wheel
+ */
+typedef struct {
+    int active;
+    slong wheel;
+    slong * classes;    // increasing
+    int nclasses;
+    slong rest;
+} filter_t;
+
+/**
+ * what --autotune knows of the host: cache sizes in bytes, allowed cpus, and hardware threads per core
+ */
+typedef struct {
+    char name[256];
+    slong l1, l2, l3;
+    int cpus;
+    int smt;
+} host_t;
+
+/**
+ * the chunks of an --autotune calibration run, over every thread: only the first sample blocks
+ * of each progression are factored, and their time is scaled up to the whole chunk
+ */
+typedef struct {
+    int active;
+    slong sample;       // the blocks factored per progression
+    double filing;      // the seconds in bucket_init
+    double sieving;     // the seconds in the blocks factored
+    slong sampled;      // the n in the blocks factored
+    slong total;        // the n in the chunks
+} calibration_t;
+
+/**
+ * the on-disk layout of a table file; every offset is in bytes from the start of the file
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t nsmall;        // the number of primes below SMALL_LIMIT
+    uint64_t limit;         // the wheel covers [0, limit)
+    uint64_t small_offset;  // uint32_t[nsmall], the primes below SMALL_LIMIT
+    uint64_t start_offset;  // uint32_t[nsmall + 1], where the order row of each small prime starts
+    uint64_t order_offset;  // uint16_t[], the order of r mod p for 0 <= r < p, 0 if r == 0
+    uint64_t wheel_offset;  // uint8_t[limit / 30], the primes bit-packed on a mod-30 wheel
+    uint64_t size;          // the size of the file
+} table_header_t;
+
+/**
+ * the header of a --list index file, followed by nblocks list_block_t
+ * the data file is the concatenation of the blocks; each is the increasing ss numbers in
+ * [lo, lo + block_size), delta encoded from lo as LEB128 varints
+ */
+typedef struct {
+    char magic[8];
+    uint64_t version;
+    uint64_t block_size;
+    uint64_t max;
+    uint64_t nblocks;
+    uint64_t count;
+} list_header_t;
+
+typedef struct {
+    uint64_t lo;
+    uint64_t count;
+    uint64_t offset;    // in bytes from the start of the data file
+    uint64_t bytes;
+} list_block_t;
+
+/**
+ * the state of --list: the ss numbers found by the search are bucketed by block,
+ * and each full bucket is spilled to tmp
+ */
+typedef struct {
+    slong MAX;
+    slong nblocks;
+    slong count;
+    uint32_t * buffer;  // LIST_BUFFER offsets per block
+    int * fill;
+    slong ** spills;    // the offsets in tmp of the spilled buckets of each block
+    slong * nspills;
+    FILE * tmp;
+} list_t;
+
+/**
+ * the base primes and the small-prime order tables, either mapped from a file or built in-process
+ */
+typedef struct {
+    slong limit;
+    const unsigned char * wheel;
+    int nsmall;
+    const uint32_t * small;
+    const uint32_t * start;
+    const uint16_t * order;
+    void * map;         // the mapping, if loaded from a file
+    size_t map_size;
+    void * owned;       // the heap storage, if built in-process
+} table_t;
+
+typedef struct {
+    const char * table;     // --table FILE, map the tables from FILE
+    const char * gen_table; // --gen-table FILE, write the tables to FILE and exit
+    const char * ranges;    // --ranges FILE, count each MIN MAX line of FILE
+    const char * stats;     // --stats FILE, write the histograms to FILE
+    const char * list;      // --list FILE, write the ss numbers to FILE and FILE.idx
+    int pin;                // --pin, pin thread t to the t-th allowed cpu
+    int dispatch;           // --dispatch, route each n to the fastest criterion
+    int bench_kernels;      // --bench-kernels, time the kernels against the generic criterion and exit
+    int perf_counters;      // --perf-counters, count cycles, instructions, and misses per phase
+    int autotune;           // --autotune, pick the block size, chunk size, and thread count by timing them
+    const char * profile;   // --profile FILE, save the --autotune result to FILE, or reuse it from FILE
+    slong mod;              // --mod m, count the n = a mod m
+    slong residue;          // --residue a, 0 by default
+    int has_residue;
+    slong coprime;          // --coprime k, count the n coprime to k
+} options_t;
 
 // max is 2**63 - 1 ~ 10**18
 static slong pow10[19] = {
-    1, 10, 100, 1000, 10000, 
-    100000, 1000000, 10000000, 100000000, 1000000000, 
-    10000000000, 100000000000, 1000000000000, 10000000000000, 100000000000000, 
-    1000000000000000, 10000000000000000, 100000000000000000, 1000000000000000000 
+    1, 10, 100, 1000, 10000,
+    100000, 1000000, 10000000, 100000000, 1000000000,
+    10000000000, 100000000000, 1000000000000, 10000000000000, 100000000000000,
+    1000000000000000, 10000000000000000, 100000000000000000, 1000000000000000000
+};
+
+// the residues mod 30 coprime to 30, one bit each
+static const int wheel_offsets[8] = { 1, 7, 11, 13, 17, 19, 23, 29 };
+static const signed char wheel_bits[30] = {
+    -1, 0, -1, -1, -1, -1, -1, 1, -1, -1,
+    -1, 2, -1, 3, -1, -1, -1, 4, -1, 5,
+    -1, -1, -1, 6, -1, -1, -1, -1, -1, 7
+};
+
+// the bits of the residues mod 30 at or above r
+static const unsigned char wheel_from[30] = {
+    0xff, 0xff, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xfc, 0xfc,
+    0xfc, 0xfc, 0xf8, 0xf8, 0xf0, 0xf0, 0xf0, 0xf0, 0xe0, 0xe0,
+    0xc0, 0xc0, 0xc0, 0xc0, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80
 };
 
+static table_t table;
+static __thread worker_t worker; // allocated by each thread on first touch
+static cpu_set_t allowed_cpus;   // the cpus this process may run on, for --pin
+static slong block_size = BLOCK_SIZE; // set by --autotune or --profile
+static slong chunk_size = CHUNK_SIZE;
+static profile_t profile;        // the --dispatch timings of every thread
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static perf_t perf;              // the --perf-counters totals of every thread
+static pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+static calibration_t calibration; // the --autotune timings of every thread
+static pthread_mutex_t calibration_lock = PTHREAD_MUTEX_INITIALIZER;
+static filter_t filter = { .wheel = 1, .rest = 1 }; // every n, unless --mod or --coprime
+static short small_index[SMALL_LIMIT]; // the index of a small prime in table.small, else -1
+static options_t opts;
+
+/**
+ * returns 10**n
+ * https://stackoverflow.com/a/18581693
+ */
+slong quick_pow10(int n)
+{
+    return pow10[n];
+}
+
+/**
+ * returns floor(sqrt(n))
+ */
+slong isqrt(slong n)
+{
+    if (n < 2) {
+        return n;
+    }
+
+    // newton's method from above, starting at ceil(n / 2) without overflowing n + 1
+    slong x = n, y = x / 2 + x % 2;
+    while (y < x) {
+        x = y;
+        y = (x + n / x) / 2;
+    }
+
+    return x;
+}
+
+/**
+ * sieves the primes below 30 * nbytes onto a mod-30 wheel, one byte per 30 integers
+ */
+void sieve_wheel(unsigned char * wheel, slong nbytes)
+{
+    slong limit = 30 * nbytes;
+    slong k, kq, p, q, m;
+    int b, bq, done;
+
+    memset(wheel, 0xff, nbytes);
+    wheel[0] &= ~1; // 1 is not prime
+
+    for (k = 0; k < nbytes; k++) {
+        for (b = 0; b < 8; b++) {
+            p = 30 * k + wheel_offsets[b];
+            if (p * p >= limit) {
+                return;
+            }
+            if (!(wheel[k] & (1 << b))) {
+                continue;
+            }
+
+            // cross off p * q for every q >= p coprime to 30
+            for (kq = k, done = 0; !done; kq++) {
+                for (bq = 0; bq < 8; bq++) {
+                    q = 30 * kq + wheel_offsets[bq];
+                    if (q < p) {
+                        continue;
+                    }
+
+                    m = p * q;
+                    if (m >= limit) {
+                        done = 1;
+                        break;
+                    }
+                    wheel[m / 30] &= ~(1 << wheel_bits[m % 30]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * fills the primes below SMALL_LIMIT and, for each such p, the order of r mod p for 0 < r < p
+ * returns the number of primes; start must have room for SMALL_LIMIT + 1 entries
+ */
+int build_orders(uint32_t * small, uint32_t * start, uint16_t * order)
+{
+    int nsmall = 0;
+    slong p, r, x, o, d;
+
+    for (p = 2; p < SMALL_LIMIT; p++) {
+        for (d = 2; d * d <= p; d++) {
+            if (p % d == 0) {
+                break;
+            }
+        }
+        if (d * d <= p) {
+            continue;
+        }
+
+        small[nsmall] = p;
+        start[nsmall + 1] = start[nsmall] + p;
+
+        if (order != NULL) {
+            order[start[nsmall]] = 0;
+            for (r = 1; r < p; r++) {
+                for (x = r, o = 1; x != 1; o++) {
+                    x = (x * r) % p;
+                }
+                order[start[nsmall] + r] = o;
+            }
+        }
+
+        nsmall++;
+    }
+
+    return nsmall;
+}
+
+/**
+ * fills small_index from table.small
+ */
+void index_small_primes(void)
+{
+    int i;
+
+    memset(small_index, 0xff, sizeof(small_index));
+    for (i = 0; i < table.nsmall; i++) {
+        small_index[table.small[i]] = i;
+    }
+}
+
+/**
+ * builds the tables in-process, with the wheel covering [0, limit)
+ * returns 0 on success, else 1
+ */
+int build_table(slong limit)
+{
+    static uint32_t small[SMALL_LIMIT], start[SMALL_LIMIT + 1];
+    slong nbytes = limit / 30 + 1;
+    int nsmall;
+
+    start[0] = 0;
+    nsmall = build_orders(small, start, NULL);
+
+    // one allocation for the orders and the wheel
+    uint16_t * order = malloc(start[nsmall] * sizeof(uint16_t) + nbytes);
+    if (order == NULL) {
+        flint_printf("[ERROR] cannot allocate %wd bytes for the primes below %wd.\n", nbytes, limit);
+
+        return 1;
+    }
+    unsigned char * wheel = (unsigned char *) (order + start[nsmall]);
+    build_orders(small, start, order);
+    sieve_wheel(wheel, nbytes);
+
+    table.limit = 30 * nbytes;
+    table.wheel = wheel;
+    table.nsmall = nsmall;
+    table.small = small;
+    table.start = start;
+    table.order = order;
+    table.map = NULL;
+    table.owned = order;
+
+    index_small_primes();
+
+    return 0;
+}
+
+/**
+ * writes the tables, with the wheel covering [0, limit), to path
+ * returns 0 on success, else 1
+ */
+int gen_table(const char * path, slong limit)
+{
+    uint32_t small[SMALL_LIMIT], start[SMALL_LIMIT + 1];
+    table_header_t header;
+    slong nbytes = limit / 30 + 1;
+    int nsmall;
+
+    start[0] = 0;
+    nsmall = build_orders(small, start, NULL);
+    uint16_t * order = malloc(start[nsmall] * sizeof(uint16_t));
+    if (order != NULL) {
+        build_orders(small, start, order);
+    }
+
+    unsigned char * wheel = malloc(nbytes);
+    if (order == NULL || wheel == NULL) {
+        flint_printf("[ERROR] cannot allocate %wd bytes for the primes below %wd.\n", nbytes, limit);
+        free(order);
+        free(wheel);
+
+        return 1;
+    }
+    sieve_wheel(wheel, nbytes);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TABLE_MAGIC, sizeof(header.magic));
+    header.version = TABLE_VERSION;
+    header.nsmall = nsmall;
+    header.limit = 30 * nbytes;
+    header.small_offset = sizeof(header);
+    header.start_offset = header.small_offset + nsmall * sizeof(uint32_t);
+    header.order_offset = header.start_offset + (nsmall + 1) * sizeof(uint32_t);
+    // keep the wheel 8-byte aligned
+    header.wheel_offset = (header.order_offset + start[nsmall] * sizeof(uint16_t) + 7) & ~((uint64_t) 7);
+    header.size = header.wheel_offset + nbytes;
+
+    FILE * fp = fopen(path, "wb");
+    if (fp == NULL) {
+        printf("[ERROR] cannot open %s.\n", path);
+        free(order);
+        free(wheel);
+
+        return 1;
+    }
+
+    uint64_t zero = 0;
+    uint64_t pad = header.wheel_offset - (header.order_offset + start[nsmall] * sizeof(uint16_t));
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+        fwrite(small, sizeof(uint32_t), nsmall, fp) == (size_t) nsmall &&
+        fwrite(start, sizeof(uint32_t), nsmall + 1, fp) == (size_t) nsmall + 1 &&
+        fwrite(order, sizeof(uint16_t), start[nsmall], fp) == start[nsmall] &&
+        fwrite(&zero, 1, pad, fp) == pad &&
+        fwrite(wheel, 1, nbytes, fp) == (size_t) nbytes;
+
+    ok = (fclose(fp) == 0) && ok;
+    free(order);
+    free(wheel);
+
+    if (!ok) {
+        printf("[ERROR] cannot write %s.\n", path);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * returns 1 if count entries of elem bytes at offset fit in a file of size bytes and are aligned, else 0
+ */
+static int table_fits(uint64_t offset, uint64_t count, uint64_t elem, uint64_t size)
+{
+    return offset % elem == 0 && offset <= size && count <= (size - offset) / elem;
+}
+
+/**
+ * maps the tables read-only from path; co-located processes share the pages
+ * returns 0 on success, else 1
+ */
+int load_table(const char * path)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        printf("[ERROR] cannot open %s.\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+
+        return 1;
+    }
+
+    void * map = NULL;
+    if ((size_t) st.st_size >= sizeof(table_header_t)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd); // the mapping outlives the descriptor
+
+    if (map == NULL || map == MAP_FAILED) {
+        printf("[ERROR] cannot map %s.\n", path);
+
+        return 1;
+    }
+
+    const table_header_t * header = map;
+    if
+    (
+        memcmp(header->magic, TABLE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != TABLE_VERSION ||
+        header->nsmall > SMALL_LIMIT ||
+        header->size != (uint64_t) st.st_size ||
+        header->limit > (uint64_t) INT64_MAX ||
+        !table_fits(header->wheel_offset, header->limit / 30, 1, header->size) ||
+        !table_fits(header->small_offset, header->nsmall, sizeof(uint32_t), header->size) ||
+        !table_fits(header->start_offset, header->nsmall + 1, sizeof(uint32_t), header->size)
+    )
+    {
+        printf("[ERROR] %s is not a version %d table file.\n", path, TABLE_VERSION);
+        munmap(map, st.st_size);
+
+        return 1;
+    }
+
+    // every small prime is below SMALL_LIMIT, and its order row has an entry for each residue
+    const uint32_t * small = (const uint32_t *) ((const char *) map + header->small_offset);
+    const uint32_t * start = (const uint32_t *) ((const char *) map + header->start_offset);
+    uint32_t i;
+    int corrupt = start[0] != 0 ||
+        !table_fits(header->order_offset, start[header->nsmall], sizeof(uint16_t), header->size);
+    for (i = 0; i < header->nsmall && !corrupt; i++) {
+        corrupt = small[i] < 2 || small[i] >= SMALL_LIMIT || start[i + 1] < start[i] ||
+            start[i + 1] - start[i] != small[i];
+    }
+    if (corrupt) {
+        printf("[ERROR] %s has corrupt order tables.\n", path);
+        munmap(map, st.st_size);
+
+        return 1;
+    }
+
+    table.limit = header->limit;
+    table.wheel = (const unsigned char *) map + header->wheel_offset;
+    table.nsmall = header->nsmall;
+    table.small = small;
+    table.start = start;
+    table.order = (const uint16_t *) ((const char *) map + header->order_offset);
+    table.map = map;
+    table.map_size = st.st_size;
+    table.owned = NULL;
+
+    index_small_primes();
+
+    return 0;
+}
+
+/**
+ * releases the tables
+ */
+void free_table(void)
+{
+    if (table.map != NULL) {
+        munmap(table.map, table.map_size);
+    }
+    free(table.owned);
+    memset(&table, 0, sizeof(table));
+}
+
+/**
+ * returns the inverse of a mod p, for a coprime to p
+ */
+static inline slong inverse_mod(slong a, slong p)
+{
+    slong t = 0, u = 1, r = p, s = a % p, q, x;
+
+    // extended euclid, keeping only the coefficient of a
+    while (s != 0) {
+        q = r / s;
+        x = t - q * u;
+        t = u;
+        u = x;
+        x = r - q * s;
+        r = s;
+        s = x;
+    }
+
+    return (t < 0) ? t + p : t;
+}
+
+/**
+ * returns the index of the first multiple of the prime p in lo, lo + step, lo + 2 * step, ...,
+ * or -1 if p divides step, when p divides every term or none
+ */
+static inline slong first_multiple(slong p, slong lo, slong step)
+{
+    slong i = (p - lo % p) % p;
+
+    if (step == 1) {
+        return i;
+    }
+    if (step % p == 0) {
+        return -1;
+    }
+
+    // p < 2**32, so the product fits
+    return (slong) ((ulong) i * inverse_mod(step % p, p) % p);
+}
+
+/**
+ * divides the multiples of the prime p among lo, lo + step, ..., lo + (len - 1) * step by their power of p
+ */
+static inline void sieve_prime(slong p, slong lo, slong step, slong len, slong * rem, factor_t * factors)
+{
+    slong i = first_multiple(p, lo, step), stride = p;
+    int e;
+
+    if (i < 0) {
+        if (lo % p != 0) {
+            return;
+        }
+        i = 0;
+        stride = 1;
+    }
+
+    for (; i < len; i += stride) {
+        factor_t * f = factors + i;
+
+        e = 0;
+        do {
+            rem[i] /= p;
+            e++;
+        } while (rem[i] % p == 0);
+
+        f->p[f->num] = p;
+        f->e[f->num] = e;
+        f->num++;
+    }
+}
+
+/**
+ * returns the least prime greater than p, or table.limit if the wheel has none
+ */
+static inline slong next_prime(slong p)
+{
+    if (p < 5) {
+        return (p < 2) ? 2 : (p < 3) ? 3 : 5;
+    }
+
+    slong k = (p + 1) / 30;
+    unsigned int bits = table.wheel[k] & wheel_from[(p + 1) % 30];
+
+    while (bits == 0) {
+        if (++k >= table.limit / 30) {
+            return table.limit;
+        }
+        bits = table.wheel[k];
+    }
+
+    return 30 * k + wheel_offsets[__builtin_ctz(bits)];
+}
+
+/**
+ * divides every n in lo, lo + step, ..., lo + (len - 1) * step by its powers of the base primes up to plimit
+ * rem is scratch space for len entries
+ */
+void sieve_block(slong lo, slong step, slong len, slong plimit, slong * rem, factor_t * factors)
+{
+    slong i, k, p;
+    unsigned int bits;
+
+    for (i = 0; i < len; i++) {
+        rem[i] = lo + i * step;
+        factors[i].num = 0;
+    }
+
+    sieve_prime(2, lo, step, len, rem, factors);
+    sieve_prime(3, lo, step, len, rem, factors);
+    sieve_prime(5, lo, step, len, rem, factors);
+
+    for (k = 0; 30 * k <= plimit; k++) {
+        bits = table.wheel[k];
+        while (bits) {
+            p = 30 * k + wheel_offsets[__builtin_ctz(bits)];
+            bits &= bits - 1;
+
+            if (p > plimit) {
+                break;
+            }
+            sieve_prime(p, lo, step, len, rem, factors);
+        }
+    }
+}
+
+/**
+ * appends what is left over of every n after sieving with the base primes up to sqrt(n),
+ * which is 1 or a prime greater than sqrt(n)
+ */
+void finish_block(slong len, const slong * rem, factor_t * factors)
+{
+    slong i;
+
+    for (i = 0; i < len; i++) {
+        if (rem[i] > 1) {
+            factor_t * f = factors + i;
+
+            f->p[f->num] = rem[i];
+            f->e[f->num] = 1;
+            f->num++;
+        }
+    }
+}
+
+/**
+ * factors every n in lo, lo + step, ..., lo + (len - 1) * step by sieving with the base primes up to
+ * the square root of the last
+ * rem is scratch space for len entries
+ */
+void factor_block(slong lo, slong step, slong len, slong * rem, factor_t * factors)
+{
+    sieve_block(lo, step, len, isqrt(lo + (len - 1) * step), rem, factors);
+    finish_block(len, rem, factors);
+}
+
+/**
+ * inserts the prime p with exponent e into the factorization f, keeping the primes in increasing order
+ */
+static inline void factor_insert(factor_t * f, slong p, int e)
+{
+    int j;
+
+    for (j = f->num; j > 0 && f->p[j - 1] > p; j--) {
+        f->p[j] = f->p[j - 1];
+        f->e[j] = f->e[j - 1];
+    }
+    f->p[j] = p;
+    f->e[j] = e;
+    f->num++;
+}
+
+/**
+ * files the large prime p under the block b of the chunk, at offset i in that block
+ */
+static inline void bucket_push(slong b, uint32_t p, uint32_t i)
+{
+    bucket_page_t * page = worker.buckets[b];
+
+    if (page == NULL || page->num == BUCKET_PAGE) {
+        bucket_page_t * fresh = worker.free_pages;
+
+        if (fresh != NULL) {
+            worker.free_pages = fresh->next;
+        }
+        else {
+            fresh = malloc(sizeof(bucket_page_t));
+            if (fresh == NULL) {
+                printf("[ERROR] cannot allocate the buckets of a chunk.\n");
+                exit(1);
+            }
+        }
+        fresh->next = page;
+        fresh->num = 0;
+        worker.buckets[b] = page = fresh;
+    }
+
+    page->entries[page->num].p = p;
+    page->entries[page->num].i = i;
+    page->num++;
+}
+
+/**
+ * files every base prime in (plimit, sqrt(hi)] under the block of the chunk it first hits, where the chunk
+ * is the num n lo, lo + step, ..., hi; primes that miss the chunk are never filed, and the primes that
+ * divide step are kept in worker.fixed if they divide every n
+ */
+void bucket_init(slong lo, slong step, slong num, slong plimit)
+{
+    slong nblocks = (num - 1) / block_size + 1;
+    slong root = isqrt(lo + (num - 1) * step);
+    slong p, m;
+
+    if (nblocks > worker.nbuckets) {
+        free(worker.buckets);
+        worker.buckets = malloc(nblocks * sizeof(bucket_page_t *));
+        if (worker.buckets == NULL) {
+            flint_printf("[ERROR] cannot allocate the buckets of %wd blocks.\n", nblocks);
+            exit(1);
+        }
+        worker.nbuckets = nblocks;
+    }
+    memset(worker.buckets, 0, nblocks * sizeof(bucket_page_t *));
+
+    // sieve_block always takes out 2, 3, and 5, even if plimit is smaller
+    worker.nfixed = 0;
+    for (p = next_prime(FLINT_MAX(plimit, 5)); p <= root; p = next_prime(p)) {
+        m = first_multiple(p, lo, step); // the index of the first multiple
+        if (m < 0) {
+            if (lo % p == 0) {
+                worker.fixed[worker.nfixed++] = p;
+            }
+        }
+        else if (m < num) {
+            bucket_push(m / block_size, p, m % block_size);
+        }
+    }
+}
+
+/**
+ * divides the n of the block b of a chunk of num n by the large primes filed under it,
+ * keeping the primes of each n in increasing order, then files each prime under the next block it hits
+ */
+void bucket_sieve(slong num, slong b, slong * rem, factor_t * factors)
+{
+    bucket_page_t * page = worker.buckets[b], * next;
+    slong m;
+    int k, e;
+
+    worker.buckets[b] = NULL;
+    for (; page != NULL; page = next) {
+        for (k = 0; k < page->num; k++) {
+            slong p = page->entries[k].p;
+            slong i = page->entries[k].i;
+            factor_t * f = factors + i;
+
+            e = 0;
+            do {
+                rem[i] /= p;
+                e++;
+            } while (rem[i] % p == 0);
+
+            // the large primes of a block come in any order
+            factor_insert(f, p, e);
+
+            // p > block_size, so its next multiple is in a later block
+            m = b * block_size + i + p;
+            if (m < num) {
+                bucket_push(m / block_size, p, m % block_size);
+            }
+        }
+
+        next = page->next;
+        page->next = worker.free_pages;
+        worker.free_pages = page;
+    }
+}
+
+/**
+ * divides the len n of a block by the large primes in worker.fixed, which divide every one of them
+ */
+void fixed_sieve(slong len, slong * rem, factor_t * factors)
+{
+    slong i, p;
+    int k, e;
+
+    for (k = 0; k < worker.nfixed; k++) {
+        p = worker.fixed[k];
+        for (i = 0; i < len; i++) {
+            e = 0;
+            do {
+                rem[i] /= p;
+                e++;
+            } while (rem[i] % p == 0);
+
+            factor_insert(factors + i, p, e);
+        }
+    }
+}
+
+/**
+ * returns 1 if p divides q**e - 1 for some 1 <= e <= e_max, else return 0
+ */
+static inline int divides_some_power(slong p, slong q, slong e_max)
+{
+    if (e_max == 1) {
+        return (q - 1) % p == 0;
+    }
+
+    // the order of q mod p is at most e_max
+    if (p < SMALL_LIMIT && small_index[p] >= 0) {
+        uint16_t o = table.order[table.start[small_index[p]] + q % p];
+
+        return o != 0 && o <= e_max;
+    }
+
+    // q**e divides n, so it cannot overflow
+    slong product = 1;
+    for (slong e = 1; e <= e_max; e++) {
+        product *= q;
+        if ((product - 1) % p == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * returns 1 if the n factored by factors is an ss number, else return 0
+ * the generic loop over any omega(n); is_ss_kernels is the unrolled equivalent
+ */
+int is_ss_factors(const factor_t * factors)
+{
+    // the number of factors
+    slong limit = factors->num;
+
+    // try all combinations of p_i and p_j
+    slong i, j, k; // the indices
+    slong p_i, p_j, e_i, e_j, p_k;
+
+    for (i = 0; i < limit; i++) {
+        for (j = 0; j < limit; j++) {
+            if (j == i) {
+                continue;
+            }
+
+            p_i = factors->p[i]; // the ith factor
+            p_j = factors->p[j]; // the jth factor
+            e_i = factors->e[i]; // the ith exponent
+            e_j = factors->e[j]; // the jth exponent
+
+            // condition 1: gcd(p_i, Pi) == gcd(p_i, p_j - 1)
+            // since p_i is prime, both are p_i or 1
+            if (divides_some_power(p_i, p_j, e_j) != ((p_j - 1) % p_i == 0)) {
+                return 0;
+            }
+
+            // condition 2: when p_i <= e_j
+            if (p_i <= e_j && i < j) {
+                // condition 2a: we must have 1 <= e_i <= 2
+                if (e_i > 2) {
+                    return 0;
+                }
+
+                // condition 2b: p_i**e_i divides p_j - 1
+                if ((p_j - 1) % (e_i == 1 ? p_i : p_i * p_i) != 0) {
+                    return 0;
+                }
+
+                // condition 2c: no p_k exists (i < k < j)
+                // s.t. p_i divides p_k - 1 and p_k divides p_j - 1
+                for (k = i + 1; k < j; k++) {
+                    p_k = factors->p[k]; // the (i + 1)th factor
+
+                    if
+                    (
+                        ((p_k - 1) % p_i == 0) &&
+                        ((p_j - 1) % p_k == 0)
+                    )
+                    {
+                        return 0;
+                    }
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * the criterion of ss.c for exactly W distinct primes, copied into fixed-size arrays
+ * W is a constant in each instantiation below, so the pair and triple loops are fully unrolled
+ */
+static inline __attribute__((always_inline)) int ss_kernel(const factor_t * factors, const int W)
+{
+    slong p[MAX_OMEGA + 1], e[MAX_OMEGA + 1];
+    int i, j, k;
+
+    #pragma GCC unroll 16
+    for (i = 0; i < W; i++) {
+        p[i] = factors->p[i];
+        e[i] = factors->e[i];
+    }
+
+    #pragma GCC unroll 16
+    for (i = 0; i < W; i++) {
+        #pragma GCC unroll 16
+        for (j = 0; j < W; j++) {
+            if (j == i) {
+                continue;
+            }
+
+            // condition 1: gcd(p_i, Pi) == gcd(p_i, p_j - 1)
+            if (divides_some_power(p[i], p[j], e[j]) != ((p[j] - 1) % p[i] == 0)) {
+                return 0;
+            }
+
+            // condition 2: when p_i <= e_j
+            if (i < j && p[i] <= e[j]) {
+                // condition 2a: we must have 1 <= e_i <= 2
+                if (e[i] > 2) {
+                    return 0;
+                }
+
+                // condition 2b: p_i**e_i divides p_j - 1
+                if ((p[j] - 1) % (e[i] == 1 ? p[i] : p[i] * p[i]) != 0) {
+                    return 0;
+                }
+
+                // condition 2c: no p_k exists (i < k < j)
+                // s.t. p_i divides p_k - 1 and p_k divides p_j - 1
+                #pragma GCC unroll 16
+                for (k = i + 1; k < j; k++) {
+                    if (((p[k] - 1) % p[i] == 0) && ((p[j] - 1) % p[k] == 0)) {
+                        return 0;
+                    }
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+#define KERNEL(NAME, W) \
+    static __attribute__((unused)) int NAME##_##W(const factor_t * factors) { return NAME(factors, W); }
+
+#define KERNEL_AT(NAME, W, LIMIT, GENERIC) ((W) <= (LIMIT) ? NAME##_##W : GENERIC)
+
+// instantiates the kernel NAME for every omega(n), and NAME##s, the criterion by omega(n): the kernel
+// up to LIMIT, and the generic loop GENERIC above it, where the unrolled code no longer pays off
+// the kernels above LIMIT are never referenced, so they are dropped before they are optimized
+#define KERNELS(NAME, LIMIT, GENERIC) \
+    KERNEL(NAME, 0) KERNEL(NAME, 1) KERNEL(NAME, 2) KERNEL(NAME, 3) \
+    KERNEL(NAME, 4) KERNEL(NAME, 5) KERNEL(NAME, 6) KERNEL(NAME, 7) \
+    KERNEL(NAME, 8) KERNEL(NAME, 9) KERNEL(NAME, 10) KERNEL(NAME, 11) \
+    KERNEL(NAME, 12) KERNEL(NAME, 13) KERNEL(NAME, 14) KERNEL(NAME, 15) \
+    static const criterion_t NAME##s[MAX_OMEGA + 1] = { \
+        KERNEL_AT(NAME, 0, LIMIT, GENERIC), KERNEL_AT(NAME, 1, LIMIT, GENERIC), KERNEL_AT(NAME, 2, LIMIT, GENERIC), KERNEL_AT(NAME, 3, LIMIT, GENERIC), \
+        KERNEL_AT(NAME, 4, LIMIT, GENERIC), KERNEL_AT(NAME, 5, LIMIT, GENERIC), KERNEL_AT(NAME, 6, LIMIT, GENERIC), KERNEL_AT(NAME, 7, LIMIT, GENERIC), \
+        KERNEL_AT(NAME, 8, LIMIT, GENERIC), KERNEL_AT(NAME, 9, LIMIT, GENERIC), KERNEL_AT(NAME, 10, LIMIT, GENERIC), KERNEL_AT(NAME, 11, LIMIT, GENERIC), \
+        KERNEL_AT(NAME, 12, LIMIT, GENERIC), KERNEL_AT(NAME, 13, LIMIT, GENERIC), KERNEL_AT(NAME, 14, LIMIT, GENERIC), KERNEL_AT(NAME, 15, LIMIT, GENERIC) \
+    };
+
+// by --bench-kernels, the ss.c kernels are 1.1-2.8x faster than the generic loop up to omega 12
+KERNELS(ss_kernel, 12, is_ss_factors)
+
+/**
+ * the criterion of ss.c through the kernel for omega(n): returns 1 if the n factored by factors
+ * is an ss number, else return 0
+ */
+int is_ss_kernels(const factor_t * factors)
+{
+    return ss_kernels[factors->num](factors);
+}
+
+/**
+ * the criterion of ss_h.c: returns 1 if the n factored by factors is an ss number, else return 0
+ */
+int is_ss_h_factors(const factor_t * factors)
+{
+    // the number of factors
+    slong limit = factors->num;
+
+    slong d, t; // the indices
+    slong i, j, k;
+    slong p, q, r, a_p, a_q, a_r;
+    slong pd, qt; // p^d, q^t
+
+    if (limit == 1) {
+        return 1;
+    }
+    // try all permutations of p, q
+    for (i = 0; i < limit; i++) {
+        for (j = 0; j < limit; j++) {
+            if (i == j) {
+                continue;
+            }
+
+            p = factors->p[i];
+            a_p = factors->e[i];
+            q = factors->p[j];
+            a_q = factors->e[j];
+
+            // (1) for t <= a_q and d <= a_p
+            // if p^d divides (q^t)-1, then p^d divides q-1
+            // p^d and q^t divide n, so they cannot overflow
+            for (t = 1, qt = q; t <= a_q; t++, qt *= q) {
+                for (d = 1, pd = p; d <= a_p; d++, pd *= p) {
+                    if
+                    (
+                        // if
+                        ( (qt - 1) % pd == 0 ) &&
+                        // then (negation)
+                        ( (q - 1) % pd != 0 )
+                    )
+                    {
+                        return 0;
+                    }
+
+                    if (d == a_p) {
+                        break;
+                    }
+                }
+
+                if (t == a_q) {
+                    break;
+                }
+            }
+
+            if (i > j) {
+                continue;
+            }
+
+            // (2) if p^3 divides n and p^3 divides q-1, then a_q < p
+            if
+            (
+                // if
+                ( a_p >= 3 ) && ( (q - 1) % (p * p * p) == 0 ) &&
+                // then (negation)
+                ( a_q >= p )
+            )
+            {
+                return 0;
+            }
+        }
+    }
+
+    if (limit == 2) {
+        return 1;
+    }
+
+    // (3)
+    // try all combinations of p, q, r where p < q < r
+    for (i = 0; i < (limit - 2); i++) {
+        for (j = i + 1; j < (limit - 1); j++) {
+            for (k = j + 1; k < limit; k++) {
+                p = factors->p[i];
+                q = factors->p[j];
+                r = factors->p[k];
+                a_r = factors->e[k];
+
+                // criterion (3): if p divides q-1 and pq divides r-1, then a_r < p
+                if
+                (
+                    // if
+                    ( (q - 1) % p == 0 ) && ( (r - 1) % (p * q) == 0 ) &&
+                    // then (negation)
+                    ( a_r >= p )
+                )
+                {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * the criterion of ss_h.c for exactly W distinct primes, copied into fixed-size arrays
+ * the pair and triple loops over the primes are fully unrolled; the loops over the exponents are not
+ */
+static inline __attribute__((always_inline)) int ss_h_kernel(const factor_t * factors, const int W)
+{
+    slong p[MAX_OMEGA + 1], e[MAX_OMEGA + 1];
+    slong d, t, pd, qt; // p^d, q^t
+    int i, j, k;
+
+    if (W == 1) {
+        return 1;
+    }
+
+    #pragma GCC unroll 16
+    for (i = 0; i < W; i++) {
+        p[i] = factors->p[i];
+        e[i] = factors->e[i];
+    }
+
+    // try all permutations of p_i, p_j
+    #pragma GCC unroll 16
+    for (i = 0; i < W; i++) {
+        #pragma GCC unroll 16
+        for (j = 0; j < W; j++) {
+            if (i == j) {
+                continue;
+            }
+
+            // (1) for t <= a_j and d <= a_i, if p_i^d divides (p_j^t)-1, then p_i^d divides p_j-1
+            for (t = 1, qt = p[j]; t <= e[j]; t++, qt *= p[j]) {
+                for (d = 1, pd = p[i]; d <= e[i]; d++, pd *= p[i]) {
+                    if ((qt - 1) % pd == 0 && (p[j] - 1) % pd != 0) {
+                        return 0;
+                    }
+
+                    if (d == e[i]) {
+                        break;
+                    }
+                }
+
+                if (t == e[j]) {
+                    break;
+                }
+            }
+
+            // (2) if p_i^3 divides n and p_i^3 divides p_j-1, then a_j < p_i
+            if (i < j && e[i] >= 3 && (p[j] - 1) % (p[i] * p[i] * p[i]) == 0 && e[j] >= p[i]) {
+                return 0;
+            }
+        }
+    }
+
+    // (3) for p_i < p_j < p_k: if p_i divides p_j-1 and p_i p_j divides p_k-1, then a_k < p_i
+    #pragma GCC unroll 16
+    for (i = 0; i < W - 2; i++) {
+        #pragma GCC unroll 16
+        for (j = i + 1; j < W - 1; j++) {
+            #pragma GCC unroll 16
+            for (k = j + 1; k < W; k++) {
+                if ((p[j] - 1) % p[i] == 0 && (p[k] - 1) % (p[i] * p[j]) == 0 && e[k] >= p[i]) {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+// the ss_h.c kernels are 1.1-1.3x faster up to omega 6, and slower above it
+KERNELS(ss_h_kernel, 6, is_ss_h_factors)
+
+/**
+ * the criterion of ss_h.c through the kernel for omega(n)
+ */
+int is_ss_h_kernels(const factor_t * factors)
+{
+    return ss_h_kernels[factors->num](factors);
+}
+
+/**
+ * the criterion of ss_pazderski.c: returns 1 if the n factored by factors is an ss number, else return 0
+ */
+int is_ss_pazderski_factors(const factor_t * factors)
+{
+    // the number of factors
+    slong limit = factors->num;
+
+    slong i, k, j; // the indices
+    slong p_i, a_i, p_k, a_k, p_j;
+    slong p, q, v, v_max;
+    slong qv, qi; // q^v, q^i
+
+    // alternate (1): n is not an SS# if it has a factor of the form p * q^v (v >= 2)
+    // and p divides q^v - 1 and p does not divide q^i - 1 (i < v)
+    for (j = 0; j < limit; j++) {
+        v_max = factors->e[j];
+
+        if (v_max < 2) {
+            continue;
+        }
+
+        q = factors->p[j];
+        for (v = 2, qv = q * q; v <= v_max; v++, qv *= q) {
+            for (k = 0; k < limit; k++) {
+                if (k == j) {
+                    continue;
+                }
+
+                p = factors->p[k];
+
+                if ((qv - 1) % p != 0) {
+                    continue;
+                }
+
+                for (i = 1, qi = q; i < v; i++, qi *= q) {
+                    if ((qi - 1) % p != 0) {
+                        return 0;
+                    }
+                }
+            }
+
+            if (v == v_max) {
+                break; // q^(v_max + 1) may overflow
+            }
+        }
+    }
+
+    // condition 2: if there exists p_i <= a_k (i != k)
+    // try all p_i <= a_k
+    for (i = 0; i < limit; i++) {
+        p_i = factors->p[i];
+        a_i = factors->e[i];
+        for (k = 0; k < limit; k++) {
+            p_k = factors->p[k];
+            a_k = factors->e[k];
+
+            // condition 2
+            if (i != k && p_i <= a_k) {
+                // condition 2a: there does not exist a prime p_j
+                // s.t. p_i divides p_j - 1 and p_j divides p_k - 1
+                for (j = 0; j < limit; j++) {
+                    p_j = factors->p[j];
+
+                    if
+                    (
+                        ((p_j - 1) % p_i == 0) &&
+                        ((p_k - 1) % p_j == 0)
+                    )
+                    {
+                        return 0;
+                    }
+                }
+
+                // condition 2b: a_i <= 2
+                // if a_i == 2, then p_i**2 divides p_k - 1
+                if
+                (
+                    (a_i > 2) ||
+                    ( a_i == 2 && ((p_k - 1) % (p_i * p_i) != 0) )
+                )
+                {
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * the criterion of ss_pazderski.c for exactly W distinct primes, copied into fixed-size arrays
+ * the pair loops over the primes are fully unrolled; the scan of condition 2a and the loops over
+ * the exponents are not
+ */
+static inline __attribute__((always_inline)) int pazderski_kernel(const factor_t * factors, const int W)
+{
+    slong p[MAX_OMEGA + 1], e[MAX_OMEGA + 1];
+    slong v, m, qv, qm; // q^v, q^m
+    int i, j, k;
+
+    #pragma GCC unroll 16
+    for (i = 0; i < W; i++) {
+        p[i] = factors->p[i];
+        e[i] = factors->e[i];
+    }
+
+    // alternate (1): n is not an SS# if it has a factor of the form p_k * p_j^v (v >= 2)
+    // and p_k divides p_j^v - 1 and p_k does not divide p_j^m - 1 (m < v)
+    #pragma GCC unroll 16
+    for (j = 0; j < W; j++) {
+        if (e[j] < 2) {
+            continue;
+        }
+
+        for (v = 2, qv = p[j] * p[j]; v <= e[j]; v++, qv *= p[j]) {
+            #pragma GCC unroll 16
+            for (k = 0; k < W; k++) {
+                if (k == j || (qv - 1) % p[k] != 0) {
+                    continue;
+                }
+
+                for (m = 1, qm = p[j]; m < v; m++, qm *= p[j]) {
+                    if ((qm - 1) % p[k] != 0) {
+                        return 0;
+                    }
+                }
+            }
+
+            if (v == e[j]) {
+                break; // p_j^(a_j + 1) may overflow
+            }
+        }
+    }
+
+    // condition 2: for p_i <= a_k (i != k)
+    #pragma GCC unroll 16
+    for (i = 0; i < W; i++) {
+        #pragma GCC unroll 16
+        for (k = 0; k < W; k++) {
+            if (i == k || p[i] > e[k]) {
+                continue;
+            }
+
+            // condition 2a: no p_j s.t. p_i divides p_j - 1 and p_j divides p_k - 1
+            // a scan over the fixed-size arrays; unrolled too, the W**3 copies take minutes to compile
+            #pragma GCC unroll 1
+            for (j = 0; j < W; j++) {
+                if ((p[j] - 1) % p[i] == 0 && (p[k] - 1) % p[j] == 0) {
+                    return 0;
+                }
+            }
+
+            // condition 2b: a_i <= 2, and if a_i == 2, then p_i**2 divides p_k - 1
+            if (e[i] > 2 || (e[i] == 2 && (p[k] - 1) % (p[i] * p[i]) != 0)) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+// the ss_pazderski.c kernels are 1.15-3.4x faster up to omega 10, and within 8% above it
+KERNELS(pazderski_kernel, 10, is_ss_pazderski_factors)
+
+/**
+ * the criterion of ss_pazderski.c through the kernel for omega(n)
+ */
+int is_ss_pazderski_kernels(const factor_t * factors)
+{
+    return pazderski_kernels[factors->num](factors);
+}
+
+// the criteria through their kernels, and the generic loops they are checked against
+static const criterion_t criteria[NUM_CRITERIA] = {
+    is_ss_kernels, is_ss_h_kernels, is_ss_pazderski_kernels
+};
+static const criterion_t generic_criteria[NUM_CRITERIA] = {
+    is_ss_factors, is_ss_h_factors, is_ss_pazderski_factors
+};
+static const char * criteria_names[NUM_CRITERIA] = { "ss", "ss_h", "pazderski" };
+
+/**
+ * adds the ss number n, factored by factors, to the histograms
+ */
+static inline void stats_add(stats_t * stats, slong n, const factor_t * factors)
+{
+    int i, m, e_max = 0;
+
+    stats->omega[factors->num]++;
+
+    if (factors->num > 0) {
+        slong p = factors->p[0];
+        stats->spf[p < SMALL_LIMIT ? p : SMALL_LIMIT]++;
+    }
+
+    for (m = 2; m <= STATS_MOD; m++) {
+        stats->mod[m][n % m]++;
+    }
+
+    for (i = 0; i < factors->num; i++) {
+        e_max = FLINT_MAX(e_max, factors->e[i]);
+    }
+    stats->exp[e_max]++;
+}
+
+/**
+ * adds the histograms of src to dst
+ */
+void stats_merge(stats_t * dst, const stats_t * src)
+{
+    const slong * s = (const slong *) src;
+    slong * d = (slong *) dst;
+
+    for (size_t i = 0; i < sizeof(stats_t) / sizeof(slong); i++) {
+        d[i] += s[i];
+    }
+}
+
+/**
+ * writes the nonzero bins of stats as N, histogram, bin, count lines
+ */
+void stats_write(FILE * fp, const char * N, const stats_t * stats)
+{
+    int i, m;
+
+    for (i = 0; i <= MAX_OMEGA; i++) {
+        if (stats->omega[i] != 0) {
+            flint_fprintf(fp, "%s\tomega\t%d\t%wd\n", N, i, stats->omega[i]);
+        }
+    }
+    for (i = 0; i < SMALL_LIMIT; i++) {
+        if (stats->spf[i] != 0) {
+            flint_fprintf(fp, "%s\tspf\t%d\t%wd\n", N, i, stats->spf[i]);
+        }
+    }
+    if (stats->spf[SMALL_LIMIT] != 0) {
+        flint_fprintf(fp, "%s\tspf\t>%d\t%wd\n", N, SMALL_LIMIT, stats->spf[SMALL_LIMIT]);
+    }
+    for (m = 2; m <= STATS_MOD; m++) {
+        for (i = 0; i < m; i++) {
+            flint_fprintf(fp, "%s\tmod%d\t%d\t%wd\n", N, m, i, stats->mod[m][i]);
+        }
+    }
+    for (i = 0; i < 64; i++) {
+        if (stats->exp[i] != 0) {
+            flint_fprintf(fp, "%s\tmax_exp\t%d\t%wd\n", N, i, stats->exp[i]);
+        }
+    }
+}
+
+/**
+ * returns the --dispatch exponent bucket of n, its largest exponent capped at DISPATCH_EXP
+ */
+static inline int dispatch_exp(const factor_t * factors)
+{
+    int i, e = 0;
+
+    for (i = 0; i < factors->num; i++) {
+        e = FLINT_MAX(e, factors->e[i]);
+    }
+
+    return FLINT_MIN(e, DISPATCH_EXP);
+}
+
+/**
+ * times every criterion on the n of a block, bucket by bucket, and routes each bucket
+ * with enough samples to the fastest one so far
+ */
+void profile_block(const factor_t * factors, slong len)
+{
+    slong start[(MAX_OMEGA + 1) * (DISPATCH_EXP + 1) + 1];
+    slong i, s, b, hits[NUM_CRITERIA];
+    int c, best;
+    struct timespec t0, t1;
+
+    // counting sort the block by bucket
+    memset(start, 0, sizeof(start));
+    for (i = 0; i < len; i++) {
+        start[factors[i].num * (DISPATCH_EXP + 1) + dispatch_exp(factors + i) + 1]++;
+    }
+    for (b = 1; b <= (MAX_OMEGA + 1) * (DISPATCH_EXP + 1); b++) {
+        start[b] += start[b - 1];
+    }
+    slong fill[(MAX_OMEGA + 1) * (DISPATCH_EXP + 1)];
+    memcpy(fill, start, sizeof(fill));
+    for (i = 0; i < len; i++) {
+        worker.order[fill[factors[i].num * (DISPATCH_EXP + 1) + dispatch_exp(factors + i)]++] = i;
+    }
+
+    for (b = 0; b < (MAX_OMEGA + 1) * (DISPATCH_EXP + 1); b++) {
+        slong num = start[b + 1] - start[b];
+        int w = b / (DISPATCH_EXP + 1), e = b % (DISPATCH_EXP + 1);
+
+        if (num == 0) {
+            continue;
+        }
+
+        for (c = 0; c < NUM_CRITERIA; c++) {
+            hits[c] = 0;
+
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            for (s = start[b]; s < start[b + 1]; s++) {
+                hits[c] += criteria[c](factors + worker.order[s]);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+
+            worker.profile.ns[w][e][c] += (t1.tv_sec - t0.tv_sec) * 1000000000.0 + (t1.tv_nsec - t0.tv_nsec);
+        }
+        worker.profile.samples[w][e] += num;
+
+        // the criteria are presumably equivalent; count the n where they are not
+        if (hits[1] != hits[0] || hits[2] != hits[0]) {
+            for (s = start[b]; s < start[b + 1]; s++) {
+                const factor_t * f = factors + worker.order[s];
+                int r = criteria[0](f);
+
+                if (criteria[1](f) != r || criteria[2](f) != r) {
+                    worker.profile.disagree++;
+                }
+            }
+        }
+
+        // route on every profile of this thread so far, which smooths out timer noise
+        if (worker.profile.samples[w][e] >= PROFILE_MIN) {
+            const double * total = worker.profile.ns[w][e];
+
+            for (c = 1, best = 0; c < NUM_CRITERIA; c++) {
+                if (total[c] < total[best]) {
+                    best = c;
+                }
+            }
+            worker.route[w][e] = best;
+        }
+    }
+}
+
+/**
+ * prints the --dispatch timings of every thread, and the routing table they imply
+ */
+void profile_report(void)
+{
+    int w, e, c, best;
+
+    printf("dispatch omega\tmax_exp\tsamples\t");
+    for (c = 0; c < NUM_CRITERIA; c++) {
+        printf("%s (ns/n)\t", criteria_names[c]);
+    }
+    printf("route\n");
+
+    for (w = 0; w <= MAX_OMEGA; w++) {
+        for (e = 0; e <= DISPATCH_EXP; e++) {
+            if (profile.samples[w][e] == 0) {
+                continue;
+            }
+
+            printf("dispatch %d\t%s%d\t", w, (e == DISPATCH_EXP) ? ">=" : "", e);
+            flint_printf("%wd\t", profile.samples[w][e]);
+            for (c = 1, best = 0; c < NUM_CRITERIA; c++) {
+                if (profile.ns[w][e][c] < profile.ns[w][e][best]) {
+                    best = c;
+                }
+            }
+            for (c = 0; c < NUM_CRITERIA; c++) {
+                printf("%.1f\t", profile.ns[w][e][c] / profile.samples[w][e]);
+            }
+            printf("%s\n", criteria_names[best]);
+        }
+    }
+
+    if (profile.disagree != 0) {
+        flint_printf("[WARNING] the criteria disagree on %wd profiled n.\n", profile.disagree);
+    }
+}
+
+// the generic events of --perf-counters, in the order of perf_t.counts
+static const uint64_t perf_events[PERF_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+static const char * perf_names[PERF_EVENTS] = { "cycles", "instructions", "cache-misses", "branch-misses" };
+static const char * phase_names[PERF_PHASES] = { "factorization", "criterion", "bookkeeping" };
+
+/**
+ * reads the counters of the calling thread and adds what they counted since the last read
+ * to the phase that was running, then starts counting for phase
+ */
+static inline void perf_switch(int phase)
+{
+    // PERF_FORMAT_GROUP: nr, time_enabled, time_running, then one value per opened counter
+    uint64_t values[3 + PERF_EVENTS];
+    int c, v;
+
+    if (!opts.perf_counters || worker.perf_fd[0] < 0) {
+        return;
+    }
+
+    if (read(worker.perf_fd[0], values, sizeof(values)) > 0) {
+        for (c = 0, v = 3; c < PERF_EVENTS; c++) {
+            if (worker.perf_fd[c] < 0) {
+                continue;
+            }
+            worker.perf.counts[worker.perf_phase][c] += values[v] - worker.perf_last[c];
+            worker.perf_last[c] = values[v++];
+        }
+        worker.perf.enabled = values[1];
+        worker.perf.running = values[2];
+    }
+
+    worker.perf_phase = phase;
+}
+
+/**
+ * opens the counters of the calling thread as one group led by the cycles counter
+ * if they are not permitted or not supported, the thread runs without them
+ */
+void perf_open(void)
+{
+    struct perf_event_attr attr;
+    int c;
+
+    memset(&worker.perf, 0, sizeof(worker.perf));
+    memset(worker.perf_last, 0, sizeof(worker.perf_last));
+    worker.perf_phase = PHASE_BOOKKEEPING;
+
+    for (c = 0; c < PERF_EVENTS; c++) {
+        worker.perf_fd[c] = -1;
+        if (!opts.perf_counters || (c > 0 && worker.perf_fd[0] < 0)) {
+            continue;
+        }
+
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = perf_events[c];
+        attr.disabled = (c == 0); // the leader starts the group
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // this thread, any cpu
+        worker.perf_fd[c] = syscall(SYS_perf_event_open, &attr, 0, -1, (c == 0) ? -1 : worker.perf_fd[0], 0);
+    }
+
+    if (worker.perf_fd[0] >= 0) {
+        worker.perf.opened = 1;
+        ioctl(worker.perf_fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+/**
+ * stops the counters of the calling thread and adds them to perf
+ */
+void perf_close(void)
+{
+    int c, p;
+
+    if (!opts.perf_counters) {
+        return;
+    }
+    perf_switch(PHASE_BOOKKEEPING);
+
+    pthread_mutex_lock(&perf_lock);
+    for (p = 0; p < PERF_PHASES; p++) {
+        for (c = 0; c < PERF_EVENTS; c++) {
+            perf.counts[p][c] += worker.perf.counts[p][c];
+        }
+    }
+    perf.n += worker.perf.n;
+    perf.enabled += worker.perf.enabled;
+    perf.running += worker.perf.running;
+    perf.opened += worker.perf.opened;
+    perf.threads++;
+    pthread_mutex_unlock(&perf_lock);
+
+    for (c = 0; c < PERF_EVENTS; c++) {
+        if (worker.perf_fd[c] >= 0) {
+            close(worker.perf_fd[c]);
+        }
+    }
+}
+
+/**
+ * prints the --perf-counters totals of every thread: IPC, and counts per n, by phase
+ */
+void perf_report(void)
+{
+    int c, p;
+
+    if (perf.opened == 0) {
+        printf("[WARNING] the perf counters could not be opened (see /proc/sys/kernel/perf_event_paranoid), none were counted.\n");
+
+        return;
+    }
+    if (perf.opened < perf.threads) {
+        printf("[WARNING] only %d of %d threads got perf counters.\n", perf.opened, perf.threads);
+    }
+    if (perf.running < perf.enabled) {
+        printf("[WARNING] the perf counters were multiplexed %.0f%% of the time, the counts are partial.\n",
+            100.0 * (perf.enabled - perf.running) / perf.enabled);
+    }
+
+    printf("perf phase\tIPC");
+    for (c = 0; c < PERF_EVENTS; c++) {
+        printf("\t%s/n", perf_names[c]);
+    }
+    printf("\n");
+
+    for (p = 0; p < PERF_PHASES; p++) {
+        const uint64_t * counts = perf.counts[p];
+
+        printf("perf %s\t%.2f", phase_names[p], counts[0] ? (double) counts[1] / counts[0] : 0.0);
+        for (c = 0; c < PERF_EVENTS; c++) {
+            printf("\t%.3f", perf.n ? (double) counts[c] / perf.n : 0.0);
+        }
+        printf("\n");
+    }
+}
+
+/**
+ * returns 1 if the factorization f has none of the primes of filter.rest, else 0
+ */
+static inline int coprime_to_rest(const factor_t * f)
+{
+    int k;
+
+    for (k = 0; k < f->num; k++) {
+        if (filter.rest % f->p[k] == 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * returns the number of ss numbers among the num n lo, lo + step, ..., factoring them a block at a time
+ * adds them to stats unless it is NULL
+ * the calling thread must have called worker_init
+ */
+slong count_progression(slong lo, slong step, slong num, stats_t * stats)
+{
+    factor_t * factors = worker.factors;
+    slong count = 0, total = num;
+    slong len, i, b, j, start;
+    struct timespec t0, t1, t2;
+
+    // a calibration run only factors the first blocks; they get the same large primes as in
+    // the whole progression, and bucket_init still runs over every base prime
+    if (calibration.active) {
+        num = FLINT_MIN(num, calibration.sample * block_size);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+    }
+
+    // once the base primes outgrow a block, the larger ones hit a block at most once
+    // and are bucketed by the block they hit next
+    int bucketed = isqrt(lo + (num - 1) * step) > block_size;
+    if (bucketed) {
+        perf_switch(PHASE_FACTOR);
+        bucket_init(lo, step, num, block_size);
+    }
+
+    if (calibration.active) {
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+    }
+
+    for (b = 0, j = 0; j < num; j += len, b++) {
+        start = lo + j * step;
+        len = FLINT_MIN(block_size, num - j);
+
+        perf_switch(PHASE_FACTOR);
+        if (bucketed) {
+            sieve_block(start, step, len, block_size, worker.rem, factors);
+            bucket_sieve(num, b, worker.rem, factors);
+            fixed_sieve(len, worker.rem, factors);
+            finish_block(len, worker.rem, factors);
+        }
+        else {
+            factor_block(start, step, len, worker.rem, factors);
+        }
+
+        perf_switch(PHASE_CRITERION);
+        worker.perf.n += len;
+
+        if (opts.dispatch && worker.blocks++ % PROFILE_PERIOD == 0) {
+            profile_block(factors, len);
+        }
+
+        for (i = 0; i < len; i++) {
+            if (filter.rest > 1 && !coprime_to_rest(factors + i)) {
+                continue;
+            }
+
+            if
+            (
+                opts.dispatch ?
+                criteria[worker.route[factors[i].num][dispatch_exp(factors + i)]](factors + i) == 1 :
+                is_ss_kernels(factors + i) == 1
+            )
+            {
+                count++;
+
+                if (stats != NULL) {
+                    stats_add(stats, start + i * step, factors + i);
+                }
+            }
+        }
+    }
+    perf_switch(PHASE_BOOKKEEPING);
+
+    if (calibration.active) {
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+
+        pthread_mutex_lock(&calibration_lock);
+        calibration.filing += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1000000000.0;
+        calibration.sieving += (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1000000000.0;
+        calibration.sampled += num;
+        calibration.total += total;
+        pthread_mutex_unlock(&calibration_lock);
+    }
+
+    return count;
+}
+
+/**
+ * returns the number of ss numbers in [lo, hi] that pass the filter, adding them to stats unless it is NULL
+ * each class of the filter is counted as a progression, so the other n are never factored
+ * the calling thread must have called worker_init
+ */
+slong count_range(slong lo, slong hi, stats_t * stats)
+{
+    slong count = 0, offset;
+    int c;
+
+    if (!filter.active) {
+        return count_progression(lo, 1, hi - lo + 1, stats);
+    }
+
+    for (c = 0; c < filter.nclasses; c++) {
+        offset = (filter.classes[c] - lo % filter.wheel + filter.wheel) % filter.wheel;
+        if (offset <= hi - lo) {
+            count += count_progression(lo + offset, filter.wheel, (hi - lo - offset) / filter.wheel + 1, stats);
+        }
+    }
+
+    return count;
+}
+
+/**
+ * pins the calling thread to the cpu-th allowed cpu (wrapping around), then allocates
+ * and touches its scratch space so the pages are placed on the thread's node
+ */
+void worker_init(int cpu)
+{
+    if (cpu >= 0) {
+        int nallowed = CPU_COUNT(&allowed_cpus);
+        int c, i = cpu % nallowed;
+        cpu_set_t set;
+
+        for (c = 0; i > 0 || !CPU_ISSET(c, &allowed_cpus); c++) {
+            if (CPU_ISSET(c, &allowed_cpus)) {
+                i--;
+            }
+        }
+
+        CPU_ZERO(&set);
+        CPU_SET(c, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    worker.rem = malloc(block_size * sizeof(slong));
+    worker.factors = malloc(block_size * sizeof(factor_t));
+    memset(worker.rem, 0, block_size * sizeof(slong));
+    memset(worker.factors, 0, block_size * sizeof(factor_t));
+
+    // every bucket starts on the criterion of ss.c
+    worker.order = opts.dispatch ? malloc(block_size * sizeof(int)) : NULL;
+    worker.blocks = 0;
+    memset(worker.route, 0, sizeof(worker.route));
+    memset(&worker.profile, 0, sizeof(worker.profile));
+
+    worker.buckets = NULL;
+    worker.nbuckets = 0;
+    worker.free_pages = NULL;
+
+    perf_open();
+}
+
+/**
+ * frees the scratch space of the calling thread, adding its --dispatch timings to profile
+ */
+void worker_free(void)
+{
+    perf_close();
+
+    if (opts.dispatch) {
+        const double * ns = (const double *) worker.profile.ns;
+        const slong * samples = (const slong *) worker.profile.samples;
+        size_t i;
+
+        pthread_mutex_lock(&profile_lock);
+        for (i = 0; i < sizeof(profile.ns) / sizeof(double); i++) {
+            ((double *) profile.ns)[i] += ns[i];
+        }
+        for (i = 0; i < sizeof(profile.samples) / sizeof(slong); i++) {
+            ((slong *) profile.samples)[i] += samples[i];
+        }
+        profile.disagree += worker.profile.disagree;
+        pthread_mutex_unlock(&profile_lock);
+    }
+
+    free(worker.rem);
+    free(worker.factors);
+    free(worker.order);
+
+    // every page is back on the free list once a chunk is done
+    while (worker.free_pages != NULL) {
+        bucket_page_t * next = worker.free_pages->next;
+        free(worker.free_pages);
+        worker.free_pages = next;
+    }
+    free(worker.buckets);
+}
+
+/**
+ * the function invoked by a thread, which takes arg, a pointer, and returns a pointer
+ * takes chunks from the queue until it is empty
+ */
+void * thread(void * arg) {
+    myarg_t * myarg = (myarg_t *) arg; // define myarg, a myarg_t pointer, and point it to the value at arg
+    range_queue_t * queue = myarg->queue;
+
+    slong piece = -1, lo = 0, hi = 0, count = 0, total = 0;
+
+    worker_init(myarg->cpu);
+
+    // the thread touches its own histograms first
+    if (myarg->stats != NULL) {
+        memset(myarg->stats, 0, sizeof(stats_t));
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        // hand in the last chunk
+        if (piece >= 0) {
+            queue->pieces[piece].count += count;
+        }
+        // take the next chunk; a piece is left once its MAX is handed out, so nothing
+        // past MAX (which may be 2**63 - 1) is ever computed
+        piece = queue->next;
+        if (piece < queue->num) {
+            lo = queue->cursor;
+            hi = lo + FLINT_MIN(queue->pieces[piece].MAX - lo, queue->chunk - 1);
+            if (hi == queue->pieces[piece].MAX) {
+                queue->next++;
+                if (queue->next < queue->num) {
+                    queue->cursor = queue->pieces[queue->next].MIN;
+                }
+            }
+            else {
+                queue->cursor = hi + 1;
+            }
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        if (piece >= queue->num) {
+            break;
+        }
+        count = count_range(lo, hi, myarg->stats);
+        total += count;
+    }
+
+    // counted locally, written to the shared myarg_t once
+    myarg->count += total;
+
+    worker_free();
+
+    flint_cleanup();
+    return NULL; // return NULL; terminate the thread
+}
+
+/**
+ * returns the length of the chunks the threads take from the queue for a run up to MAX
+ * sets *clamped (unless it is NULL) to whether the buckets, not chunk_size, decided it
+ */
+slong queue_chunk(slong MAX, int * clamped)
+{
+    slong chunk = chunk_size, root = isqrt(MAX);
+
+    // the chunks are counted a class at a time; each class gets a share of the n counted per chunk
+    if (filter.active) {
+        chunk = FLINT_MAX(chunk_size / FLINT_MAX(filter.nclasses, 1), block_size);
+    }
+
+    // each chunk (each class of it) files every base prime up to sqrt(MAX) into its buckets;
+    // keep the chunks long enough for that to be a small part of their time
+    slong least = (root > block_size) ? (root / (4 * block_size) + 1) * block_size : 0;
+    if (clamped != NULL) {
+        *clamped = least > chunk;
+    }
+    chunk = FLINT_MAX(chunk, least);
+
+    // from n counted per class to the length of the chunk
+    if (filter.active) {
+        chunk = (chunk > INT64_MAX / 4 / filter.wheel) ? INT64_MAX / 4 : chunk * filter.wheel;
+    }
+
+    return chunk;
+}
+
+/**
+ * runs NUM_THREADS threads over the pieces until every chunk is counted
+ * each piece gets its count, and myargs[t] the count of thread t
+ * returns the wall-clock time in seconds
+ */
+double run_queue(myarg_t * pieces, slong npieces, myarg_t * myargs, int NUM_THREADS)
+{
+    range_queue_t queue;
+    pthread_t threads[NUM_THREADS];
+    struct timespec start, end;
+    int t;
+
+    pthread_mutex_init(&queue.lock, NULL);
+    queue.pieces = pieces;
+    queue.num = npieces;
+    queue.next = 0;
+    queue.cursor = (npieces > 0) ? pieces[0].MIN : 0;
+
+    queue.chunk = (npieces > 0) ? queue_chunk(pieces[npieces - 1].MAX, NULL) : chunk_size;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // for each thread
+    for (t = 0; t < NUM_THREADS; t++) {
+        myargs[t].count = 0;
+        myargs[t].queue = &queue;
+
+        pthread_create(&threads[t], NULL, thread, &myargs[t]);
+    }
+
+    for (t = 0; t < NUM_THREADS; t++) {
+        pthread_join(threads[t], NULL); // wait for the specified thread to terminate
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_mutex_destroy(&queue.lock);
+
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+}
+
+/**
+ * returns an array of num myarg_t, each on its own cache line as the type requires, or NULL
+ */
+myarg_t * alloc_myargs(slong num)
+{
+    myarg_t * myargs;
+
+    if (posix_memalign((void **) &myargs, 64, FLINT_MAX(num, 1) * sizeof(myarg_t)) != 0) {
+        flint_printf("[ERROR] cannot allocate %wd ranges.\n", num);
+
+        return NULL;
+    }
+
+    return myargs;
+}
+
+/**
+ * compares two myarg_t by MIN, for qsort
+ */
+int compare_min(const void * a, const void * b)
+{
+    slong x = ((const myarg_t *) a)->MIN, y = ((const myarg_t *) b)->MIN;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * compares two int, for qsort
+ */
+int compare_int(const void * a, const void * b)
+{
+    int x = *(const int *) a, y = *(const int *) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * compares two slong, for qsort
+ */
+int compare_slong(const void * a, const void * b)
+{
+    slong x = *(const slong *) a, y = *(const slong *) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * reads the MIN MAX lines of path into *ranges; blank lines and lines starting with # are skipped
+ * returns the number of ranges, or -1 on error
+ */
+slong read_ranges(const char * path, myarg_t ** ranges)
+{
+    FILE * fp = fopen(path, "r");
+    char line[256];
+    slong num = 0, alloc = 16, line_num = 0;
+    slong min, max;
+
+    if (fp == NULL) {
+        printf("[ERROR] cannot open %s.\n", path);
+
+        return -1;
+    }
+
+    *ranges = alloc_myargs(alloc);
+    if (*ranges == NULL) {
+        fclose(fp);
+
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_num++;
+
+        char * c = line;
+        while (*c == ' ' || *c == '\t') {
+            c++;
+        }
+        if (*c == '#' || *c == '\n' || *c == '\r' || *c == '\0') {
+            continue;
+        }
+
+        if (sscanf(c, "%ld %ld", &min, &max) != 2 || min < 1 || min > max || max > quick_pow10(18)) {
+            printf("[ERROR] %s line %ld: expected MIN MAX with 1 <= MIN <= MAX <= 10**18.\n", path, line_num);
+            fclose(fp);
+            free(*ranges);
+
+            return -1;
+        }
+
+        if (num == alloc) {
+            myarg_t * grown = alloc_myargs(2 * alloc);
+            if (grown == NULL) {
+                fclose(fp);
+                free(*ranges);
+
+                return -1;
+            }
+            memcpy(grown, *ranges, alloc * sizeof(myarg_t));
+            free(*ranges);
+            *ranges = grown;
+            alloc *= 2;
+        }
+        (*ranges)[num].count = 0;
+        (*ranges)[num].MIN = min;
+        (*ranges)[num].MAX = max;
+        num++;
+    }
+
+    fclose(fp);
+    return num;
+}
+
+/**
+ * splits the union of the ranges at every endpoint, so each range is a run of whole pieces
+ * returns the number of pieces written to *pieces, or -1 on error
+ */
+slong split_ranges(const myarg_t * ranges, slong num, myarg_t ** pieces)
+{
+    slong * bounds = malloc(2 * num * sizeof(slong));
+    myarg_t * sorted = alloc_myargs(num);
+    slong i, r, nbounds = 0, npieces = 0, covered;
+
+    *pieces = alloc_myargs(2 * num);
+    if (bounds == NULL || sorted == NULL || *pieces == NULL) {
+        free(bounds);
+        free(sorted);
+        free(*pieces);
+
+        return -1;
+    }
+
+    // a piece starts at every MIN and right after every MAX
+    for (i = 0; i < num; i++) {
+        bounds[nbounds++] = ranges[i].MIN;
+        bounds[nbounds++] = ranges[i].MAX + 1;
+    }
+    qsort(bounds, nbounds, sizeof(slong), compare_slong);
+
+    memcpy(sorted, ranges, num * sizeof(myarg_t));
+    qsort(sorted, num, sizeof(myarg_t), compare_min);
+
+    for (i = 0, r = 0, covered = 0; i + 1 < nbounds; i++) {
+        if (bounds[i] == bounds[i + 1]) {
+            continue;
+        }
+
+        // the furthest MAX of the ranges starting at or before this piece
+        for (; r < num && sorted[r].MIN <= bounds[i]; r++) {
+            covered = FLINT_MAX(covered, sorted[r].MAX);
+        }
+        if (covered < bounds[i]) {
+            continue; // a gap between ranges
+        }
+
+        (*pieces)[npieces].count = 0;
+        (*pieces)[npieces].MIN = bounds[i];
+        (*pieces)[npieces].MAX = bounds[i + 1] - 1;
+        npieces++;
+    }
+
+    free(bounds);
+    free(sorted);
+    return npieces;
+}
+
+/**
+ * moves the --options out of argv into opts, and the positional args into pos
+ * returns the number of positional args plus 1 (like argc), or -1 on error
+ */
+int parse_options(int argc, char* argv[], char* pos[])
+{
+    int npos = 0;
+
+    pos[npos++] = argv[0];
+    for (int a = 1; a < argc; a++) {
+        if (strncmp(argv[a], "--", 2) != 0) {
+            pos[npos++] = argv[a];
+            continue;
+        }
+
+        // the options without an argument
+        if (strcmp(argv[a], "--pin") == 0) {
+            opts.pin = 1;
+            continue;
+        }
+        if (strcmp(argv[a], "--dispatch") == 0) {
+            opts.dispatch = 1;
+            continue;
+        }
+        if (strcmp(argv[a], "--bench-kernels") == 0) {
+            opts.bench_kernels = 1;
+            continue;
+        }
+        if (strcmp(argv[a], "--perf-counters") == 0) {
+            opts.perf_counters = 1;
+            continue;
+        }
+        if (strcmp(argv[a], "--autotune") == 0) {
+            opts.autotune = 1;
+            continue;
+        }
+
+        if (a + 1 >= argc) {
+            printf("[ERROR] %s requires an argument.\n", argv[a]);
+
+            return -1;
+        }
+
+        if (strcmp(argv[a], "--table") == 0) {
+            opts.table = argv[++a];
+        }
+        else if (strcmp(argv[a], "--gen-table") == 0) {
+            opts.gen_table = argv[++a];
+        }
+        else if (strcmp(argv[a], "--ranges") == 0) {
+            opts.ranges = argv[++a];
+        }
+        else if (strcmp(argv[a], "--stats") == 0) {
+            opts.stats = argv[++a];
+        }
+        else if (strcmp(argv[a], "--list") == 0) {
+            opts.list = argv[++a];
+        }
+        else if (strcmp(argv[a], "--profile") == 0) {
+            opts.profile = argv[++a];
+        }
+        else if (strcmp(argv[a], "--mod") == 0) {
+            opts.mod = strtol(argv[++a], NULL, 10);
+            if (opts.mod < 1) {
+                printf("[ERROR] --mod must be positive.\n");
+
+                return -1;
+            }
+        }
+        else if (strcmp(argv[a], "--residue") == 0) {
+            opts.residue = strtol(argv[++a], NULL, 10);
+            opts.has_residue = 1;
+        }
+        else if (strcmp(argv[a], "--coprime") == 0) {
+            opts.coprime = strtol(argv[++a], NULL, 10);
+            if (opts.coprime < 1) {
+                printf("[ERROR] --coprime must be positive.\n");
+
+                return -1;
+            }
+        }
+        else {
+            printf("[ERROR] unknown option %s.\n", argv[a]);
+
+            return -1;
+        }
+    }
+
+    return npos;
+}
+
+/**
+ * maps or builds the tables; the sieve needs the primes up to sqrt(MAX)
+ * returns 0 on success, else 1
+ */
+int setup_table(slong MAX)
+{
+    if (opts.table == NULL) {
+        return build_table(isqrt(MAX) + 1);
+    }
+
+    if (load_table(opts.table) != 0) {
+        return 1;
+    }
+    if (table.limit <= isqrt(MAX)) {
+        flint_printf("[ERROR] %s only covers primes below %wd, need sqrt(MAX) %wd.\n",
+            opts.table, table.limit, isqrt(MAX));
+        free_table();
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * sets up the filter of --mod, --residue, and --coprime: the wheel is m times the small primes of k
+ * that do not divide m, as long as it has at most FILTER_CLASSES classes, and the classes are the
+ * residues mod the wheel that are a mod m and coprime to those primes
+ * returns 0 on success, else 1
+ */
+int setup_filter(void)
+{
+    slong m = FLINT_MAX(opts.mod, 1), a, q, d, r, t;
+    slong primes[MAX_OMEGA], skipped = 1;
+    int nprimes = 0, nclasses = 1, k;
+
+    if (opts.has_residue && opts.mod == 0) {
+        printf("[ERROR] --residue requires --mod.\n");
+
+        return 1;
+    }
+    if (opts.mod == 0 && opts.coprime == 0) {
+        return 0;
+    }
+
+    a = (opts.residue % m + m) % m;
+    filter.rest = FLINT_MAX(opts.coprime, 1);
+
+    for (q = 2; q <= FILTER_CLASSES + 1 && nprimes < MAX_OMEGA; q++) {
+        if (filter.rest % q != 0) {
+            continue;
+        }
+        // the smaller primes are divided out of rest, so q is prime unless one of them was skipped
+        for (d = 2; d * d <= q && q % d != 0; d++) {
+        }
+        if (d * d <= q) {
+            continue;
+        }
+
+        // the primes of m are on the wheel already
+        if (m % q != 0) {
+            if (nclasses * (q - 1) > FILTER_CLASSES || m > INT64_MAX / 4 / (skipped * q)) {
+                continue;
+            }
+            nclasses *= q - 1;
+            skipped *= q;
+        }
+
+        primes[nprimes++] = q;
+        while (filter.rest % q == 0) {
+            filter.rest /= q;
+        }
+    }
+
+    filter.active = 1;
+    filter.wheel = m * skipped;
+    filter.classes = malloc(skipped * sizeof(slong));
+    filter.nclasses = 0;
+    for (t = 0; t < skipped; t++) {
+        r = a + t * m;
+        for (k = 0; k < nprimes && r % primes[k] != 0; k++);
+        if (k == nprimes) {
+            filter.classes[filter.nclasses++] = r;
+        }
+    }
+    qsort(filter.classes, filter.nclasses, sizeof(slong), compare_slong);
+
+    flint_printf("filter wheel %wd, classes %d, rest %wd\n", filter.wheel, filter.nclasses, filter.rest);
+
+    return 0;
+}
+
+/**
+ * returns the size in bytes of a sysfs size like 48K, 2048K, or 32M, or 0 if path cannot be read
+ */
+slong read_sysfs_size(const char * path)
+{
+    FILE * fp = fopen(path, "r");
+    char unit = 0;
+    slong size = 0;
+
+    if (fp == NULL) {
+        return 0;
+    }
+    if (fscanf(fp, "%ld%c", &size, &unit) < 1) {
+        size = 0;
+    }
+    fclose(fp);
+
+    return (unit == 'K') ? size << 10 : (unit == 'M') ? size << 20 : (unit == 'G') ? size << 30 : size;
+}
+
+/**
+ * reads the cache sizes of cpu0 and its hardware threads per core from sysfs,
+ * and the number of cpus this process may run on
+ */
+void read_host(host_t * host)
+{
+    char path[128], type[32];
+    int index, level, a, b;
+    cpu_set_t cpus;
+
+    memset(host, 0, sizeof(host_t));
+    gethostname(host->name, sizeof(host->name) - 1);
+
+    for (index = 0; index < 16; index++) {
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/level", index);
+        FILE * fp = fopen(path, "r");
+        if (fp == NULL) {
+            break;
+        }
+        level = 0;
+        if (fscanf(fp, "%d", &level) != 1) {
+            level = 0;
+        }
+        fclose(fp);
+
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/type", index);
+        fp = fopen(path, "r");
+        type[0] = 0;
+        if (fp != NULL) {
+            if (fscanf(fp, "%31s", type) != 1) {
+                type[0] = 0;
+            }
+            fclose(fp);
+        }
+
+        sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%d/size", index);
+        if (level == 1 && strcmp(type, "Instruction") != 0) {
+            host->l1 = read_sysfs_size(path);
+        }
+        else if (level == 2) {
+            host->l2 = read_sysfs_size(path);
+        }
+        else if (level == 3) {
+            host->l3 = read_sysfs_size(path);
+        }
+    }
+
+    // e.g. 0,64 or 0-1
+    host->smt = 1;
+    FILE * fp = fopen("/sys/devices/system/cpu/cpu0/topology/thread_siblings_list", "r");
+    if (fp != NULL) {
+        host->smt = 0;
+        while (fscanf(fp, "%d", &a) == 1) {
+            b = a;
+            int c = fgetc(fp);
+            if (c == '-') {
+                if (fscanf(fp, "%d", &b) != 1) {
+                    b = a;
+                }
+                c = fgetc(fp);
+            }
+            host->smt += b - a + 1;
+            if (c != ',') {
+                break;
+            }
+        }
+        fclose(fp);
+        host->smt = FLINT_MAX(host->smt, 1);
+    }
+
+    host->cpus = (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) ?
+        CPU_COUNT(&cpus) : sysconf(_SC_NPROCESSORS_ONLN);
+    host->cpus = FLINT_MAX(host->cpus, 1);
+}
+
+/**
+ * returns the throughput in n per second of NUM_THREADS threads over the chunks of [lo, hi]
+ * with the current block_size and chunk_size, from the first AUTOTUNE_WINDOW n of each chunk
+ */
+double calibrate(slong lo, slong hi, int NUM_THREADS)
+{
+    myarg_t myargs[NUM_THREADS];
+    myarg_t piece = { 0, lo, hi, NULL, -1, NULL };
+    int t;
+
+    for (t = 0; t < NUM_THREADS; t++) {
+        myargs[t].stats = NULL;
+        myargs[t].cpu = opts.pin ? t : -1;
+    }
+
+    memset(&calibration, 0, sizeof(calibration));
+    calibration.sample = FLINT_MAX(AUTOTUNE_WINDOW / block_size / (filter.active ? filter.nclasses : 1), 1);
+    calibration.active = 1;
+    run_queue(&piece, 1, myargs, NUM_THREADS);
+    calibration.active = 0;
+
+    if (calibration.sampled == 0) {
+        return 0.0;
+    }
+
+    // the seconds each thread would spend on its whole chunks
+    double seconds = (calibration.filing + calibration.sieving * calibration.total / calibration.sampled) / NUM_THREADS;
+
+    return calibration.total / seconds;
+}
+
+/**
+ * times candidate block sizes, thread counts, and chunk sizes, one after another, at the top of
+ * [MIN, MAX], and keeps the fastest of each; the tables must be set up
+ */
+void autotune(slong MIN, slong MAX, int * NUM_THREADS)
+{
+    host_t host;
+    slong lo, window, candidate, best_block = block_size, best_chunk = chunk_size;
+    int threads, best_threads = *NUM_THREADS;
+    double rate, best;
+
+    read_host(&host);
+    flint_printf("autotune host %s, l1 %wd, l2 %wd, l3 %wd, cpus %d, smt %d\n",
+        host.name, host.l1, host.l2, host.l3, host.cpus, host.smt);
+
+    // the n the run factors, which is only the classes of the filter
+    slong factored = filter.active ? (MAX - MIN + 1) / filter.wheel * filter.nclasses : MAX - MIN + 1;
+    if (factored < (slong) AUTOTUNE_SHARE * AUTOTUNE_WINDOW * *NUM_THREADS) {
+        flint_printf("autotune skipped, the run factors fewer than %wd n per thread, keeping block_size %wd, chunk_size %wd, threads %d\n",
+            (slong) AUTOTUNE_SHARE * AUTOTUNE_WINDOW, block_size, chunk_size, *NUM_THREADS);
+
+        return;
+    }
+
+    // the block sizes from a quarter of l1 to all of l2 (or l3), one thread, one chunk
+    slong per_n = sizeof(slong) + sizeof(factor_t);
+    slong smallest = FLINT_MAX(host.l1 / 4, 1 << 14) / per_n;
+    slong largest = FLINT_MAX(host.l3 > 0 ? host.l3 / host.cpus : host.l2, 1 << 20) / per_n;
+
+    best = 0.0;
+    for (candidate = AUTOTUNE_MIN_BLOCK; candidate <= (1 << 20); candidate <<= 1) {
+        if (candidate < smallest / 2 || candidate > 2 * largest) {
+            continue;
+        }
+
+        // one chunk
+        block_size = candidate;
+        chunk_size = AUTOTUNE_WINDOW;
+        window = FLINT_MIN(queue_chunk(MAX, NULL), MAX - MIN + 1);
+        lo = MAX - window + 1;
+        rate = calibrate(lo, MAX, 1);
+        flint_printf("autotune block_size %wd\t%.0f n/s\n", block_size, rate);
+        if (rate > best) {
+            best = rate;
+            best_block = block_size;
+        }
+    }
+    block_size = best_block;
+
+    // the thread counts: powers of 2, one per core, and one per hardware thread
+    int candidates[64], ncandidates = 0, c;
+    for (threads = 1; threads < host.cpus && ncandidates < 62; threads *= 2) {
+        candidates[ncandidates++] = threads;
+    }
+    if (host.smt > 1) {
+        candidates[ncandidates++] = FLINT_MAX(host.cpus / host.smt, 1);
+    }
+    candidates[ncandidates++] = host.cpus;
+    qsort(candidates, ncandidates, sizeof(int), compare_int);
+
+    best = 0.0;
+    for (c = 0; c < ncandidates; c++) {
+        threads = candidates[c];
+        if (c > 0 && threads <= candidates[c - 1]) {
+            continue;
+        }
+
+        // one chunk per thread
+        chunk_size = AUTOTUNE_WINDOW;
+        window = FLINT_MIN(queue_chunk(MAX, NULL), (MAX - MIN + 1) / threads) * threads;
+        lo = MAX - window + 1;
+        rate = calibrate(lo, MAX, threads);
+        printf("autotune threads %d\t%.0f n/s\n", threads, rate);
+        if (rate > best) {
+            best = rate;
+            best_threads = threads;
+        }
+    }
+    *NUM_THREADS = best_threads;
+
+    // the chunk sizes, in blocks, unless the buckets set a longer chunk than chunk_size would
+    int clamped;
+    chunk_size = best_chunk = 4 * block_size;
+    slong effective = queue_chunk(MAX, &clamped);
+    if (clamped) {
+        flint_printf("autotune chunks of %wd n, set by the buckets up to sqrt(MAX), chunk_size not swept\n",
+            effective);
+    }
+    best = 0.0;
+    for (candidate = 4; candidate <= 1024 && !clamped; candidate *= 4) {
+        chunk_size = candidate * block_size;
+        window = FLINT_MIN(queue_chunk(MAX, NULL), (MAX - MIN + 1) / best_threads) * best_threads;
+        lo = MAX - window + 1;
+        rate = calibrate(lo, MAX, best_threads);
+        flint_printf("autotune chunk_size %wd\t%.0f n/s\n", chunk_size, rate);
+        if (rate > best) {
+            best = rate;
+            best_chunk = chunk_size;
+        }
+    }
+    chunk_size = best_chunk;
+
+    flint_printf("autotune picked block_size %wd, chunk_size %wd, threads %d\n",
+        block_size, chunk_size, *NUM_THREADS);
+
+    if (opts.profile != NULL) {
+        FILE * fp = fopen(opts.profile, "w");
+        if (fp == NULL) {
+            printf("[WARNING] cannot write %s, the profile is not saved.\n", opts.profile);
+
+            return;
+        }
+
+        fprintf(fp, "host %s\n", host.name);
+        flint_fprintf(fp, "block_size %wd\nchunk_size %wd\nthreads %d\n", block_size, chunk_size, *NUM_THREADS);
+        fclose(fp);
+    }
+}
+
 /**
- * returns 10**n
- * https://stackoverflow.com/a/18581693
+ * reuses the --autotune result saved in opts.profile, if it was saved on this host
  */
-slong quick_pow10(int n)
+void load_profile(int * NUM_THREADS)
 {
-    return pow10[n]; 
+    FILE * fp = fopen(opts.profile, "r");
+    char key[32], value[256], name[256] = { 0 };
+    slong block = 0, chunk = 0, threads = 0;
+
+    if (fp == NULL) {
+        printf("[WARNING] cannot open %s, using the defaults.\n", opts.profile);
+
+        return;
+    }
+
+    value[0] = 0;
+    while (fscanf(fp, "%31s %255s", key, value) == 2) {
+        if (strcmp(key, "host") == 0) {
+            strcpy(name, value);
+        }
+        else if (strcmp(key, "block_size") == 0) {
+            block = strtol(value, NULL, 10);
+        }
+        else if (strcmp(key, "chunk_size") == 0) {
+            chunk = strtol(value, NULL, 10);
+        }
+        else if (strcmp(key, "threads") == 0) {
+            threads = strtol(value, NULL, 10);
+        }
+    }
+    fclose(fp);
+
+    char host[256] = { 0 };
+    gethostname(host, sizeof(host) - 1);
+    if (strcmp(name, host) != 0) {
+        printf("[WARNING] %s was tuned on %s, not %s, using the defaults.\n", opts.profile, name, host);
+
+        return;
+    }
+    if (block < 1 || chunk < 1 || threads < 1) {
+        printf("[WARNING] %s is incomplete, using the defaults.\n", opts.profile);
+
+        return;
+    }
+    if (block < AUTOTUNE_MIN_BLOCK || chunk < block) {
+        flint_printf("[WARNING] %s has block_size %wd and chunk_size %wd, but needs %d <= block_size <= chunk_size, using the defaults.\n",
+            opts.profile, block, chunk, AUTOTUNE_MIN_BLOCK);
+
+        return;
+    }
+
+    block_size = block;
+    chunk_size = chunk;
+    *NUM_THREADS = threads;
+    flint_printf("profile block_size %wd, chunk_size %wd, threads %d\n", block_size, chunk_size, *NUM_THREADS);
 }
 
 /**
- * Sets f to the greatest common divisor of g and h. The result is always positive, even if one of g and h is negative
- * http://flintlib.org/doc/fmpz.html#c.fmpz_gcd
+ * applies --autotune or --profile before a run over [MIN, MAX]
  */
-void gcd(fmpz_t f, slong g, slong h)
+void tune(slong MIN, slong MAX, int * NUM_THREADS)
 {
-    fmpz_t a, b;
-    fmpz_init_set_si(a, g);
-    fmpz_init_set_si(b, h);
+    if (opts.autotune) {
+        autotune(MIN, MAX, NUM_THREADS);
+    }
+    else if (opts.profile != NULL) {
+        load_profile(NUM_THREADS);
+    }
 
-    fmpz_gcd(f, a, b);
+    flint_set_num_threads(*NUM_THREADS);
+    fflush(stdout);
 
-    fmpz_clear(a);
-    fmpz_clear(b);
+    // the calibration runs are not part of the --perf-counters totals or the --dispatch timings
+    memset(&perf, 0, sizeof(perf));
+    memset(&profile, 0, sizeof(profile));
 }
 
 /**
- * returns 1 if n is an ss number, else return 0
+ * counts every range of the --ranges file in one pass: overlapping ranges are split into
+ * disjoint pieces, the threads share the pieces through a chunked queue, and each range sums its pieces
  */
-int is_ss(slong n)
+int run_ranges(const char * path, int NUM_THREADS)
 {
-    // fmpz_factor_t consists of two fmpz vectors representing bases and exponents
-    fmpz_factor_t factors;
-    // Initialises an fmpz_factor_t structure
-    fmpz_factor_init(factors);
-    // takes a machine integer n as input
-    fmpz_factor_si(factors, n);
-    // the number of factors
-    slong limit = factors->num;
+    myarg_t * ranges, * pieces;
+    slong num = read_ranges(path, &ranges);
+    slong npieces, i, r, total = 0;
 
-    // try all combinations of p_i and p_j
-    slong i, j, e, k; // the indices
-    slong p_i, p_j, e_i, e_j, p_k;
-    slong gcd_1;
+    if (num < 0) {
+        return 1;
+    }
+    if (num == 0) {
+        printf("[ERROR] %s has no ranges.\n", path);
+        free(ranges);
 
-    for (i = 0; i < limit; i++) {
-        for (j = 0; j < limit; j++) {
-            if (j == i) {
-                continue;
+        return 1;
+    }
+
+    npieces = split_ranges(ranges, num, &pieces);
+    if (npieces < 0) {
+        printf("[ERROR] cannot split the ranges.\n");
+        free(ranges);
+
+        return 1;
+    }
+    flint_printf("ranges %wd, pieces %wd\n", num, npieces);
+
+    if (setup_table(pieces[npieces - 1].MAX) != 0) {
+        free(ranges);
+        free(pieces);
+
+        return 1;
+    }
+    tune(pieces[npieces - 1].MIN, pieces[npieces - 1].MAX, &NUM_THREADS);
+
+    myarg_t myargs[NUM_THREADS];
+    double cpu_time;
+    int t;
+
+    for (t = 0; t < NUM_THREADS; t++) {
+        myargs[t].stats = NULL;
+        myargs[t].cpu = opts.pin ? t : -1;
+    }
+
+    cpu_time = run_queue(pieces, npieces, myargs, NUM_THREADS);
+
+    FILE* fp = fopen("output.txt", "w");
+    fprintf(fp, "MIN\t\t\t\tMAX\t\t\t\tcount\n");
+
+    for (i = 0; i < num; i++) {
+        // binary search the piece starting at MIN, then sum the pieces up to MAX
+        slong lo = 0, hi = npieces - 1;
+        while (lo < hi) {
+            slong mid = (lo + hi) / 2;
+            if (pieces[mid].MIN < ranges[i].MIN) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
             }
+        }
+        for (r = lo; r < npieces && pieces[r].MAX <= ranges[i].MAX; r++) {
+            ranges[i].count += pieces[r].count;
+        }
+
+        flint_fprintf(fp, "%wd\t\t\t\t%wd\t\t\t\t%wd\n", ranges[i].MIN, ranges[i].MAX, ranges[i].count);
+    }
+    for (r = 0; r < npieces; r++) {
+        total += pieces[r].count;
+    }
+    fprintf(fp, "time (s) %f\n", cpu_time);
+    fclose(fp);
+
+    flint_printf("count %wd (union of the ranges)\n", total);
+    printf("cpu_time %f\n", cpu_time);
+    if (opts.dispatch) {
+        profile_report();
+    }
+    if (opts.perf_counters) {
+        perf_report();
+    }
 
-            p_i = fmpz_get_si(factors->p + i); // the ith factor
-            p_j = fmpz_get_si(factors->p + j); // the jth factor
-            e_i = fmpz_get_si(factors->exp + i); // the ith exponent
-            e_j = fmpz_get_si(factors->exp + j); // the jth exponent
-            gcd_1 = 1;
+    free(ranges);
+    free(pieces);
+    free(filter.classes);
+    free_table();
+    return 0;
+}
 
-            // get gcd(p_i, Pi)
-            for (e = 1; e <= e_j; e++) {
-                // product = the jth factor ** e - 1
-                fmpz_t product;
-                fmpz_init(product);
-                fmpz_pow_ui(product, (factors->p + j), e);
+/**
+ * buckets the ss number n by its block, spilling the bucket to the temporary file when it is full
+ */
+static inline void list_emit(list_t * list, slong n)
+{
+    slong b = n / LIST_BLOCK;
+    uint32_t * bucket = list->buffer + b * LIST_BUFFER;
 
-                if ((fmpz_get_si(product) - 1) % p_i == 0) {
-                    gcd_1 = p_i;
-                    fmpz_clear(product);
-                    break;
-                }
+    bucket[list->fill[b]++] = n - b * LIST_BLOCK;
+    list->count++;
+
+    if (list->fill[b] == LIST_BUFFER) {
+        slong * spills = realloc(list->spills[b], (list->nspills[b] + 1) * sizeof(slong));
+        if (spills == NULL) {
+            printf("[ERROR] cannot allocate the spills of a block.\n");
+            exit(1);
+        }
+        list->spills[b] = spills;
+        list->spills[b][list->nspills[b]++] = ftell(list->tmp);
+        fwrite(bucket, sizeof(uint32_t), LIST_BUFFER, list->tmp);
+        list->fill[b] = 0;
+    }
+}
+
+/**
+ * extends the ss number m, factored by factors, by every prime power above its largest prime
+ * since the ss numbers are closed under divisors, a prefix that is not an ss number is never extended
+ */
+void list_search(list_t * list, factor_t * factors, slong m)
+{
+    slong bound = list->MAX / m; // the largest p with m * p <= MAX
+    slong p, pe;
+    int i = factors->num, e;
+
+    for (p = next_prime(i > 0 ? factors->p[i - 1] : 1); p <= bound; p = next_prime(p)) {
+        factors->num = i + 1;
+        factors->p[i] = p;
 
-                fmpz_clear(product);
+        for (e = 1, pe = p; ; e++) {
+            factors->e[i] = e;
+            if (is_ss_kernels(factors) == 0) {
+                break;
             }
 
-            // get gcd(p_i, p_j - 1)
-            fmpz_t gcd_2;
-            fmpz_init(gcd_2);
-            gcd(gcd_2, p_i, p_j - 1);
+            list_emit(list, m * pe);
+            list_search(list, factors, m * pe);
 
-            // condition 1: gcd_1 == gcd_2
-            if (gcd_1 != fmpz_get_si(gcd_2)) {
-                fmpz_clear(gcd_2);
-                fmpz_factor_clear(factors);
-                
-                return 0;
+            // m * p**(e + 1) > MAX
+            if (pe > bound / p) {
+                break;
             }
-            
-            // condition 2: when p_i <= e_j
-            if (p_i <= e_j && i < j) {
-                // condition 2a: we must have 1 <= e_i <= 2
-                if (e_i > 2) {
-                    fmpz_clear(gcd_2);
-                    fmpz_factor_clear(factors);
-                    
-                    return 0;
-                }
+            pe *= p;
+        }
+    }
 
-                // product = the ith factor ** the ith exp
-                fmpz_t product;
-                fmpz_init(product);
-                fmpz_pow_ui(product, (factors->p + i), e_i);
+    factors->num = i;
+}
 
-                // condition 2b: p_i**e_i divides p_j - 1
-                if ((p_j - 1) % fmpz_get_si(product) != 0) {
-                    fmpz_clear(gcd_2);
-                    fmpz_clear(product);
-                    fmpz_factor_clear(factors);
-                    
-                    return 0;
-                }
+/**
+ * writes the LEB128 varint x to buf, returns the number of bytes
+ */
+static inline int put_varint(unsigned char * buf, uint64_t x)
+{
+    int len = 0;
 
-                // condition 2c: no p_k exists (i < k < j)
-                // s.t. p_i divides p_k - 1 and p_k divides p_j - 1 
-                for (k = i + 1; k < j; k++) {
-                    p_k = fmpz_get_si(factors->p + k); // the (i + 1)th factor
+    while (x >= 0x80) {
+        buf[len++] = (x & 0x7f) | 0x80;
+        x >>= 7;
+    }
+    buf[len++] = x;
 
-                    if 
-                    (
-                        ((p_k - 1) % p_i == 0) &&
-                        ((p_j - 1) % p_k == 0)
-                    )
-                    {
-                        fmpz_clear(gcd_2);
-                        fmpz_clear(product);
-                        fmpz_factor_clear(factors);
+    return len;
+}
 
-                        return 0;
-                    }
-                }
+/**
+ * compares two uint32_t, for qsort
+ */
+int compare_uint32(const void * a, const void * b)
+{
+    uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
 
-                fmpz_clear(product);
-            }
+    return (x > y) - (x < y);
+}
+
+/**
+ * lists every ss number in [2, MAX] to path, with the index at path.idx
+ * the numbers are built by a search over their factorizations instead of testing every n,
+ * then sorted and delta + varint encoded one block at a time
+ */
+int run_list(const char * path, slong MAX)
+{
+    list_t list;
+    slong b, i, n;
+
+    // the wheel up to MAX (unless mapped), a buffer per block, and the scratch space to encode a block
+    slong nblocks = MAX / LIST_BLOCK + 1;
+    slong block_len = FLINT_MIN(LIST_BLOCK, MAX + 1);
+    slong need = ((opts.table != NULL) ? 0 : MAX / 30) +
+        nblocks * (LIST_BUFFER * sizeof(uint32_t) + sizeof(int) + sizeof(slong *) + sizeof(slong)) +
+        block_len * (sizeof(uint32_t) + 5);
+    slong memory = (slong) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    if (memory > 0 && need > memory) {
+        flint_printf("[ERROR] --list needs %wd bytes for MAX %wd, more than the %wd bytes of memory.\n",
+            need, MAX, memory);
 
-            fmpz_clear(gcd_2);
+        return 1;
+    }
+
+    // the search needs every prime up to MAX
+    if (opts.table != NULL) {
+        if (load_table(opts.table) != 0) {
+            return 1;
+        }
+        if (table.limit <= MAX) {
+            flint_printf("[ERROR] %s only covers primes below %wd, --list needs MAX %wd.\n",
+                opts.table, table.limit, MAX);
+            free_table();
+
+            return 1;
         }
     }
+    else if (build_table(MAX + 1) != 0) {
+        return 1;
+    }
 
-    // Clears an fmpz_factor_t structure
-    fmpz_factor_clear(factors);
+    char idx_path[strlen(path) + 5];
+    sprintf(idx_path, "%s.idx", path);
 
-    return 1;
+    FILE * fp = fopen(path, "wb");
+    FILE * idx = fopen(idx_path, "wb");
+    list.tmp = tmpfile();
+    if (fp == NULL || idx == NULL || list.tmp == NULL) {
+        printf("[ERROR] cannot open %s, %s, or a temporary file.\n", path, idx_path);
+        free_table();
+
+        return 1;
+    }
+
+    list.MAX = MAX;
+    list.nblocks = nblocks;
+    list.count = 0;
+    list.buffer = malloc(list.nblocks * LIST_BUFFER * sizeof(uint32_t));
+    list.fill = calloc(list.nblocks, sizeof(int));
+    list.spills = calloc(list.nblocks, sizeof(slong *));
+    list.nspills = calloc(list.nblocks, sizeof(slong));
+
+    // a block holds at most min(LIST_BLOCK, MAX + 1) entries of at most 5 bytes
+    uint32_t * values = malloc(block_len * sizeof(uint32_t));
+    unsigned char * out = malloc(block_len * 5);
+
+    if (list.buffer == NULL || list.fill == NULL || list.spills == NULL || list.nspills == NULL ||
+        values == NULL || out == NULL)
+    {
+        flint_printf("[ERROR] cannot allocate the buffers of %wd blocks.\n", nblocks);
+        fclose(fp);
+        fclose(idx);
+        fclose(list.tmp);
+        free(values);
+        free(out);
+        free(list.buffer);
+        free(list.fill);
+        free(list.spills);
+        free(list.nspills);
+        free_table();
+
+        return 1;
+    }
+
+    struct timespec start, end;
+    double cpu_time = 0.0;
+    factor_t factors;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    factors.num = 0;
+    list_search(&list, &factors, 1);
+
+    // the index header, then one record per block
+    list_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LIST_MAGIC, sizeof(header.magic));
+    header.version = LIST_VERSION;
+    header.block_size = LIST_BLOCK;
+    header.max = MAX;
+    header.nblocks = list.nblocks;
+    header.count = list.count;
+    fwrite(&header, sizeof(header), 1, idx);
+
+    uint64_t offset = 0;
+
+    for (b = 0; b < list.nblocks; b++) {
+        // gather the spilled and buffered entries of the block
+        n = 0;
+        for (i = 0; i < list.nspills[b]; i++) {
+            fseek(list.tmp, list.spills[b][i], SEEK_SET);
+            n += fread(values + n, sizeof(uint32_t), LIST_BUFFER, list.tmp);
+        }
+        memcpy(values + n, list.buffer + b * LIST_BUFFER, list.fill[b] * sizeof(uint32_t));
+        n += list.fill[b];
+        qsort(values, n, sizeof(uint32_t), compare_uint32);
+
+        slong bytes = 0;
+        uint32_t prev = 0;
+        for (i = 0; i < n; i++) {
+            bytes += put_varint(out + bytes, values[i] - prev);
+            prev = values[i];
+        }
+        fwrite(out, 1, bytes, fp);
+
+        list_block_t record = { b * LIST_BLOCK, n, offset, bytes };
+        fwrite(&record, sizeof(record), 1, idx);
+        offset += bytes;
+
+        free(list.spills[b]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    cpu_time += end.tv_sec - start.tv_sec;
+    cpu_time += (end.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+    int ok = !ferror(fp) && !ferror(idx);
+    ok = (fclose(fp) == 0) && ok;
+    ok = (fclose(idx) == 0) && ok;
+    fclose(list.tmp);
+
+    free(values);
+    free(out);
+    free(list.buffer);
+    free(list.fill);
+    free(list.spills);
+    free(list.nspills);
+    free_table();
+
+    if (!ok) {
+        printf("[ERROR] cannot write %s or %s.\n", path, idx_path);
+
+        return 1;
+    }
+
+    flint_printf("count %wd\n", list.count);
+    flint_printf("bytes %wd\n", (slong) offset);
+    printf("cpu_time %f\n", cpu_time);
+
+    return 0;
 }
 
 /**
- * the function invoked by a thread, which takes arg, a pointer, and returns a pointer
+ * times the generic loop of each criterion against its kernel for each omega, on random
+ * factorizations over the small primes, and checks that they agree
  */
-void * thread(void * arg) {	
-    myarg_t * myarg = (myarg_t *) arg; // define myarg, a myarg_t pointer, and point it to the value at arg
+int run_bench_kernels(void)
+{
+    factor_t * samples = malloc(BENCH_SAMPLES * sizeof(factor_t));
+    int pool[MAX_OMEGA + 16];
+    uint64_t x = 88172645463325252ULL; // xorshift64
+    struct timespec t0, t1;
+    double ns_generic, ns_kernel;
+    slong s, r, hits_generic, hits_kernel;
+    int w, i, j, c;
+
+    if (build_table(SMALL_LIMIT) != 0) {
+        return 1;
+    }
 
-    for (slong n = myarg->MIN; n <= myarg->MAX; n++) {
-        if (is_ss(n) == 1) {
-            myarg->count++;
+    printf("criterion\tomega\tgeneric (ns/n)\tkernel (ns/n)\tspeedup\tss\n");
+    for (w = 1; w <= MAX_OMEGA; w++) {
+        // w distinct primes out of the first w + 16, in increasing order, mostly squarefree
+        for (s = 0; s < BENCH_SAMPLES; s++) {
+            for (i = 0; i < w + 16; i++) {
+                pool[i] = i;
+            }
+            for (i = 0; i < w; i++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                j = i + x % (w + 16 - i);
+                int tmp = pool[i];
+                pool[i] = pool[j];
+                pool[j] = tmp;
+            }
+            qsort(pool, w, sizeof(int), compare_int);
+
+            samples[s].num = w;
+            for (i = 0; i < w; i++) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                samples[s].p[i] = table.small[pool[i]];
+                samples[s].e[i] = (x % 4 == 0) ? 2 + (x >> 8) % 3 : 1;
+            }
         }
 
-        // flint_cleanup();
+        for (c = 0; c < NUM_CRITERIA; c++) {
+            hits_generic = hits_kernel = 0;
+
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            for (r = 0; r < BENCH_REPS; r++) {
+                for (s = 0; s < BENCH_SAMPLES; s++) {
+                    hits_generic += generic_criteria[c](samples + s);
+                }
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            ns_generic = (t1.tv_sec - t0.tv_sec) * 1000000000.0 + (t1.tv_nsec - t0.tv_nsec);
+
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            for (r = 0; r < BENCH_REPS; r++) {
+                for (s = 0; s < BENCH_SAMPLES; s++) {
+                    hits_kernel += criteria[c](samples + s);
+                }
+            }
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            ns_kernel = (t1.tv_sec - t0.tv_sec) * 1000000000.0 + (t1.tv_nsec - t0.tv_nsec);
+
+            if (hits_generic != hits_kernel) {
+                printf("[ERROR] the %s kernel for omega %d disagrees with its generic loop.\n", criteria_names[c], w);
+                free(samples);
+                free_table();
+
+                return 1;
+            }
+
+            printf("%s\t%d\t%.2f\t%.2f\t%.2f\t%.3f\n", criteria_names[c], w,
+                ns_generic / (BENCH_REPS * BENCH_SAMPLES), ns_kernel / (BENCH_REPS * BENCH_SAMPLES),
+                ns_generic / ns_kernel, (double) hits_generic / (BENCH_REPS * BENCH_SAMPLES));
+        }
     }
-        
-    flint_cleanup();
-    return NULL; // return NULL; terminate the thread
+
+    free(samples);
+    free_table();
+    return 0;
 }
 
 // slong (signed long) max is 9223372036854775807 or 2**63 - 1
@@ -184,112 +3269,274 @@ void * thread(void * arg) {
  * cmd line args: $./ss EXP NUM_THREADS or $./ss MIN MAX NUM_THREADS
  * e.g. $./ss 8 8 (10**8 max, 8 threads)
  * e.g. $./ss 2 1000 8 (2 min, 1000 max, 8 threads)
+ * options: --table FILE (map the prime tables from FILE)
+ * e.g. $./ss --gen-table primes.tbl 1000000000 (write the prime tables up to 10**9 to primes.tbl)
+ * e.g. $./ss --ranges ranges.txt 8 (count each MIN MAX line of ranges.txt, 8 threads)
+ * e.g. $./ss --list ss.list 1000000 (write the ss numbers up to 10**6 to ss.list and ss.list.idx)
+ * options: --stats FILE (write the histograms of the ss numbers at each checkpoint to FILE)
+ * options: --pin (pin thread t to the t-th cpu this process may run on)
+ * e.g. $./ss --bench-kernels (time the per-omega kernels of each criterion against its generic loop)
+ * options: --perf-counters (count cycles, instructions, cache and branch misses per phase)
+ * options: --autotune (time block sizes, chunk sizes, and thread counts near MAX first and use the fastest)
+ * options: --profile FILE (with --autotune, save the result to FILE; without, reuse it from FILE)
+ * options: --dispatch (route each n to the fastest of the three criteria, by omega(n) and largest exponent)
+ * options: --mod m --residue a (only count the n = a mod m), --coprime k (only count the n coprime to k)
  */
-int main(int argc, char* argv[]) 
+int main(int argc, char* argv[])
 {
     // the default is 10**3
-    int EXP = 3; 
+    int EXP = 3;
     slong MIN = 2;
     slong MAX = 1000;
     int NUM_THREADS = 1;
 
-    if (argc == 2 || argc > 4) {
+    char* pos[argc + 1];
+    int nargs = parse_options(argc, argv, pos);
+
+    if (nargs < 0) {
+        return 1;
+    }
+    if (opts.pin && sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus) != 0) {
+        printf("[WARNING] cannot read the cpu affinity, --pin is ignored.\n");
+        opts.pin = 0;
+    }
+
+    // write the tables and exit
+    if (opts.gen_table != NULL) {
+        if (nargs != 2) {
+            printf("[ERROR] --gen-table requires a LIMIT.\n");
+
+            return 1;
+        }
+
+        slong limit = strtol(pos[1], NULL, 10);
+        if (limit < 2) {
+            printf("[ERROR] LIMIT must be at least 2.\n");
+
+            return 1;
+        }
+
+        if (gen_table(opts.gen_table, limit) != 0) {
+            return 1;
+        }
+        flint_printf("wrote %s, limit %wd\n", opts.gen_table, limit);
+
+        return 0;
+    }
+
+    if (opts.bench_kernels) {
+        return run_bench_kernels();
+    }
+
+    // list the ss numbers instead of counting them
+    if (opts.list != NULL) {
+        if (opts.mod != 0 || opts.coprime != 0) {
+            printf("[ERROR] --mod and --coprime are not supported with --list.\n");
+
+            return 1;
+        }
+        if (nargs != 2) {
+            printf("[ERROR] --list requires a MAX.\n");
+
+            return 1;
+        }
+
+        MAX = strtol(pos[1], NULL, 10);
+        if (MAX < 2 || MAX > quick_pow10(18)) {
+            printf("[ERROR] MAX must be between 2 and 10**18.\n");
+
+            return 1;
+        }
+        flint_printf("MAX %wd\n", MAX);
+        fflush(stdout);
+
+        return run_list(opts.list, MAX);
+    }
+
+    // count many ranges in one pass
+    if (opts.ranges != NULL) {
+        if (opts.stats != NULL) {
+            printf("[ERROR] --stats is not supported with --ranges.\n");
+
+            return 1;
+        }
+        if (nargs != 2) {
+            printf("[ERROR] --ranges requires NUM_THREADS.\n");
+
+            return 1;
+        }
+
+        NUM_THREADS = strtol(pos[1], NULL, 10);
+        flint_set_num_threads(NUM_THREADS);
+        printf("num_threads %d\n", flint_get_num_threads());
+        if (setup_filter() != 0) {
+            return 1;
+        }
+
+        return run_ranges(opts.ranges, NUM_THREADS);
+    }
+
+    if (nargs == 2 || nargs > 4) {
         printf("[ERROR] incorrect number of command line arguments.\n");
 
         return 1;
     }
     // get the EXP from the cmd line args
-    if (argc == 3) {
-        EXP = strtol(argv[1], NULL, 10); // ignore leftover
+    if (nargs == 3) {
+        EXP = strtol(pos[1], NULL, 10); // ignore leftover
         MAX = quick_pow10(EXP);
         printf("EXP %d\n", EXP);
         flint_printf("MAX %wd\n", MAX);
 
-        NUM_THREADS = strtol(argv[2], NULL, 10);
+        NUM_THREADS = strtol(pos[2], NULL, 10);
     }
     // get the MIN, MAX
-    if (argc == 4) {
-        MIN = strtol(argv[1], NULL, 10);
-        MAX = strtol(argv[2], NULL, 10);
+    if (nargs == 4) {
+        MIN = strtol(pos[1], NULL, 10);
+        MAX = strtol(pos[2], NULL, 10);
         flint_printf("MIN %wd\n", MIN);
         flint_printf("MAX %wd\n", MAX);
         EXP = 1;
 
-        NUM_THREADS = strtol(argv[3], NULL, 10);
+        NUM_THREADS = strtol(pos[3], NULL, 10);
     }
 
     flint_set_num_threads(NUM_THREADS);
     printf("num_threads %d\n", flint_get_num_threads());
 
     // error check for max
-    if (argc == 3 && EXP > 18) {
+    if (nargs == 3 && EXP > 18) {
         printf("[ERROR] MAX cannot exceed 10**18.\n");
 
         return 1;
     }
-    if (argc == 4 && MIN > MAX) {
+    if (nargs == 4 && MIN > MAX) {
         printf("[ERROR] MIN cannot be greater than MAX.\n");
 
         return 1;
     }
-    fflush(stdout);
+    if (MIN < 1) {
+        printf("[ERROR] MIN must be positive.\n");
+
+        return 1;
+    }
+
+    if (setup_filter() != 0 || setup_table(MAX) != 0) {
+        return 1;
+    }
+    tune(MIN, MAX, &NUM_THREADS);
 
     FILE* fp = fopen("output.txt", "w");
 
-    pthread_t threads[NUM_THREADS];
     myarg_t myargs[NUM_THREADS];
 
-    struct timespec start, end;
+    // the per-thread histograms, merged into total at each checkpoint
+    FILE* stats_fp = NULL;
+    stats_t * stats = NULL, * total = NULL;
+    char N[32];
+    if (opts.stats != NULL) {
+        stats_fp = fopen(opts.stats, "w");
+        if (stats_fp == NULL) {
+            printf("[ERROR] cannot open %s.\n", opts.stats);
+            fclose(fp);
+            free_table();
+
+            return 1;
+        }
+        // cache-line aligned, so no two threads share a line
+        if (posix_memalign((void **) &stats, 64, NUM_THREADS * sizeof(stats_t)) != 0) {
+            printf("[ERROR] cannot allocate the histograms.\n");
+            fclose(stats_fp);
+            fclose(fp);
+            free_table();
+
+            return 1;
+        }
+        if (posix_memalign((void **) &total, 64, sizeof(stats_t)) != 0) {
+            printf("[ERROR] cannot allocate the histograms.\n");
+            free(stats);
+            fclose(stats_fp);
+            fclose(fp);
+            free_table();
+
+            return 1;
+        }
+        memset(total, 0, sizeof(stats_t));
+        fprintf(stats_fp, "N\thistogram\tbin\tcount\n");
+    }
+
     double cpu_time = 0.0;
     int e, t; // the indices
-    slong n, count, max, step;
-    n = MIN - 1; 
+    slong n, count, max;
+    myarg_t piece; // the range of the checkpoint
+    n = MIN - 1;
     count = 0; // the total
 
+    for (t = 0; t < NUM_THREADS; t++) {
+        myargs[t].stats = (stats != NULL) ? stats + t : NULL;
+        myargs[t].cpu = opts.pin ? t : -1;
+    }
+
     flint_fprintf(fp, "MIN %wd, MAX %wd\n", MIN, MAX);
+    if (filter.active) {
+        flint_fprintf(fp, "mod %wd, residue %wd, coprime %wd\n", opts.mod, opts.residue, opts.coprime);
+    }
     fprintf(fp, "N\t\t\t\tcount\t\t\t\ttime (s)\n");
     // for each exponent
     for (e = 1; e <= EXP; e++) {
-        max = (argc == 4) ? MAX : quick_pow10(e);
-        step = (max - n) / NUM_THREADS;
+        max = (nargs == 4) ? MAX : quick_pow10(e);
 
-        clock_gettime(CLOCK_MONOTONIC, &start);
+        // the threads take the range a chunk at a time
+        piece.count = 0;
+        piece.MIN = n + 1;
+        piece.MAX = max;
+        cpu_time += run_queue(&piece, (n < max) ? 1 : 0, myargs, NUM_THREADS);
 
-        // for each thread
         for (t = 0; t < NUM_THREADS; t++) {
-            myargs[t].count = 0;
-            myargs[t].MIN = n + 1;
-            myargs[t].MAX = (t == NUM_THREADS - 1) ?
-                max : n + step;
-
-            pthread_create(&threads[t], NULL, thread, &myargs[t]);
-
-            n += step;
-        }
-        
-        for (t = 0; t < NUM_THREADS; t++) {	
-            pthread_join(threads[t], NULL); // wait for the specified thread to terminate
             count += myargs[t].count; // sum
+            if (stats != NULL) {
+                stats_merge(total, stats + t);
+            }
         }
 
-        clock_gettime(CLOCK_MONOTONIC, &end);
-        cpu_time += end.tv_sec - start.tv_sec;
-        cpu_time += (end.tv_nsec - start.tv_nsec) / 1000000000.0;
-
         fflush(fp);
-        if (argc == 4) {
+        if (nargs == 4) {
             flint_fprintf(fp, "%wd\t\t\t\t%wd\t\t\t\t%f\n", MAX, count, cpu_time);
         }
         else {
             flint_fprintf(fp, "10**%d\t\t\t\t%wd\t\t\t\t%f\n", e, count, cpu_time);
         }
 
+        if (stats != NULL) {
+            if (nargs == 4) {
+                flint_sprintf(N, "%wd", MAX);
+            }
+            else {
+                sprintf(N, "10**%d", e);
+            }
+            stats_write(stats_fp, N, total);
+            fflush(stats_fp);
+        }
+
         n = max;
     }
 
     flint_printf("count %wd\n", count);
     printf("cpu_time %f\n", cpu_time);
+    if (opts.dispatch) {
+        profile_report();
+    }
+    if (opts.perf_counters) {
+        perf_report();
+    }
 
     fclose(fp);
+    if (stats != NULL) {
+        fclose(stats_fp);
+        free(stats);
+        free(total);
+    }
+    free(filter.classes);
+    free_table();
     return 0;
 }
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LIST_MAGIC "SSINDEX"
+#define LIST_VERSION 1
+
+/**
+ * the header of a --list index file, followed by nblocks list_block_t
+ * the data file is the concatenation of the blocks; each is the increasing ss numbers in
+ * [lo, lo + block_size), delta encoded from lo as LEB128 varints
+ */
+typedef struct {
+    char magic[8];
+    uint64_t version;
+    uint64_t block_size;
+    uint64_t max;
+    uint64_t nblocks;
+    uint64_t count;
+} list_header_t;
+
+typedef struct {
+    uint64_t lo;
+    uint64_t count;
+    uint64_t offset;    // in bytes from the start of the data file
+    uint64_t bytes;
+} list_block_t;
+
+/**
+ * reads a LEB128 varint from buf into *x, returns the number of bytes
+ */
+static inline int get_varint(const unsigned char * buf, uint64_t * x)
+{
+    int len = 0, shift = 0;
+
+    *x = 0;
+    do {
+        *x |= (uint64_t) (buf[len] & 0x7f) << shift;
+        shift += 7;
+    } while (buf[len++] & 0x80);
+
+    return len;
+}
+
+/**
+ * cmd line args: $./ss_decode FILE or $./ss_decode FILE MIN MAX
+ * prints the ss numbers listed by $./ss --list FILE MAX, only those in [MIN, MAX] if given
+ * the index FILE.idx is used to seek straight to the block holding MIN
+ * e.g. $./ss_decode ss.list 1000 2000
+ */
+int main(int argc, char* argv[])
+{
+    uint64_t MIN = 0, MAX = UINT64_MAX;
+
+    if (argc != 2 && argc != 4) {
+        printf("[ERROR] incorrect number of command line arguments.\n");
+
+        return 1;
+    }
+    if (argc == 4) {
+        MIN = strtoull(argv[2], NULL, 10);
+        MAX = strtoull(argv[3], NULL, 10);
+    }
+
+    char idx_path[strlen(argv[1]) + 5];
+    sprintf(idx_path, "%s.idx", argv[1]);
+
+    FILE * fp = fopen(argv[1], "rb");
+    FILE * idx = fopen(idx_path, "rb");
+    if (fp == NULL || idx == NULL) {
+        printf("[ERROR] cannot open %s or %s.\n", argv[1], idx_path);
+
+        return 1;
+    }
+
+    list_header_t header;
+    if
+    (
+        fread(&header, sizeof(header), 1, idx) != 1 ||
+        memcmp(header.magic, LIST_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != LIST_VERSION
+    )
+    {
+        printf("[ERROR] %s is not a version %d index file.\n", idx_path, LIST_VERSION);
+
+        return 1;
+    }
+
+    // skip to the block holding MIN
+    uint64_t b = (MIN / header.block_size < header.nblocks) ? MIN / header.block_size : header.nblocks;
+    fseek(idx, sizeof(header) + b * sizeof(list_block_t), SEEK_SET);
+
+    list_block_t record;
+    unsigned char * buf = NULL;
+    uint64_t alloc = 0, i, n, delta;
+
+    for (; b < header.nblocks && b * header.block_size <= MAX; b++) {
+        if (fread(&record, sizeof(record), 1, idx) != 1) {
+            printf("[ERROR] %s is truncated.\n", idx_path);
+
+            return 1;
+        }
+
+        if (record.bytes > alloc) {
+            alloc = record.bytes;
+            buf = realloc(buf, alloc);
+        }
+        fseek(fp, record.offset, SEEK_SET);
+        if (fread(buf, 1, record.bytes, fp) != record.bytes) {
+            printf("[ERROR] %s is truncated.\n", argv[1]);
+
+            return 1;
+        }
+
+        const unsigned char * c = buf;
+        for (i = 0, n = record.lo; i < record.count; i++) {
+            c += get_varint(c, &delta);
+            n += delta;
+
+            if (n > MAX) {
+                break;
+            }
+            if (n >= MIN) {
+                printf("%llu\n", (unsigned long long) n);
+            }
+        }
+    }
+
+    free(buf);
+    fclose(fp);
+    fclose(idx);
+    return 0;
+}